@@ -137,6 +137,17 @@ ALWAYS_INLINE void perfMonitorCountCycles(void)
 	__setPmnc(PM_EVT(PM_EVT_INST_EXEC, PM_EVT_ICACHE_MISS) | PM_CCNT_IRQ | PM_PMN1_IRQ |
 	          PM_PMN0_IRQ | PM_CCNT_NODIV | PM_CCNT_RST | PM_PMN01_RST | PM_EN);
 }
+
+// Makes sure the Cycle Counter Register runs with divider 64.
+// Keeps the event selection of an already running monitor
+// but it will count every 64th cycle from now on.
+ALWAYS_INLINE void perfMonitorCcntDiv64(void)
+{
+	// Don't clear pending overflow flags by writing them back.
+	const u32 pmnc = __getPmnc() & ~(PM_CCNT_IRQ | PM_PMN1_IRQ | PM_PMN0_IRQ);
+	if((pmnc & PM_EN) == 0) __setPmnc(pmnc | PM_CCNT_DIV64 | PM_CCNT_RST | PM_EN);
+	else if((pmnc & PM_CCNT_DIV64) == 0) __setPmnc(pmnc | PM_CCNT_DIV64);
+}
 #endif // #if !__ASSEMBLER__
 
 #ifdef __cplusplus
@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+#include "fatfs/source/ff.h"
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct
+{
+	u32 hits;       // Single sector reads served from the sector cache.
+	u32 misses;     // Single sector reads that went to the card.
+	u32 writeBacks; // Dirty sectors written back to the card.
+	u32 bypasses;   // Single sector accesses not cached because all ways were pinned.
+
+	u32 readAheadHits;    // Multi-sector reads served from the read-ahead buffer.
+	u32 readAheadMisses;  // Read-ahead buffers dropped because of a seek or partial hit.
+	u32 readAheadSectors; // Sectors prefetched in total.
+
+	u32 trimmedSectors;   // Sectors discarded via CTRL_TRIM or DISKIO_discardFree().
+	u32 trimsDropped;     // CTRL_TRIM ranges not queued because the TRIM queue was full.
+
+	u32 coalescedSectors; // Sectors merged in the write coalescing buffer.
+	u32 coalesceFlushes;  // Writes of the coalescing buffer to the card.
+
+	u32 reattaches;       // disk_initialize() calls which reused the previous card state.
+} DiskioStats;
+
+
+
+/**
+ * @brief      Tells the sector cache where the FAT is. FAT sectors
+ *             get the highest cache priority. Called by fMount().
+ *
+ * @param[in]  pdrv   The physical drive of the volume.
+ * @param[in]  start  The first FAT sector.
+ * @param[in]  end    The sector after the last FAT (including mirrors).
+ */
+void DISKIO_setFatRegion(BYTE pdrv, LBA_t start, LBA_t end);
+
+/**
+ * @brief      Sets the sequential read-ahead window.
+ *
+ * @param[in]  sectors  The window in sectors. Clamped to DISKIO_READAHEAD_SECTORS. 0 disables read-ahead.
+ */
+void DISKIO_setReadAhead(u32 sectors);
+
+/**
+ * @brief      Erases the next chunk of queued CTRL_TRIM ranges and puts devices to sleep
+ *             which were idle for longer than DISKIO_IDLE_TIMEOUT_MS.
+ *             Call this periodically from the main loop to process the TRIM queue.
+ *             The idle clock IRQ puts devices to sleep on its own. The next access wakes them up.
+ *             Skipped while a filesystem function holds the FatFs lock.
+ *             See SDMMC_getStats() for sleep/wake counters.
+ */
+void DISKIO_pollIdle(void);
+
+/**
+ * @brief      Discards all free clusters of a mounted FAT16/FAT32 volume via CTRL_TRIM.
+ *             Open files must be synced before calling this. Erases synchronously
+ *             which can take several seconds on SD cards.
+ *             Takes the FatFs lock so don't call this from inside FatFs.
+ *
+ * @param[in]  fs    The mounted filesystem object.
+ *
+ * @return     Returns true on success and false on disk errors or if the lock is busy.
+ */
+bool DISKIO_discardFree(const FATFS *const fs);
+
+/**
+ * @brief      Outputs the diskio statistics.
+ *
+ * @param      statsOut  A pointer to a DiskioStats struct.
+ */
+void DISKIO_getStats(DiskioStats *const statsOut);
+
+/**
+ * @brief      Resets the diskio statistics.
+ */
+void DISKIO_resetStats(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
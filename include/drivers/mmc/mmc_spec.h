@@ -127,6 +127,7 @@ extern "C"
 #define MMC_R1_STATE_DIS             (8u<<9)  // S R   A
 #define MMC_R1_STATE_BTST            (9u<<9)  // S R   A
 #define MMC_R1_STATE_SLP             (10u<<9) // S R   A
+#define MMC_R1_STATE_MASK            (15u<<9)
 #define MMC_R1_ERASE_RESET           BIT(13)  // E R   B, An erase sequence was cleared before executing because an out of erase sequence command was received (commands other than CMD35, CMD36, CMD38 or CMD13.
 #define MMC_R1_WP_ERASE_SKIP         BIT(15)  // E X   B, Only partial address space was erased due to existing write protected blocks.
 #define MMC_R1_CXD_OVERWRITE         BIT(16)  // E X   B, Can be either one of the following errors: - The CID register has been already written and can not be overwritten - The read only section of the CSD does not match the card content. - An attempt to reverse the copy (set as original) or permanent WP (unprotected) bits was made.
@@ -19,6 +19,9 @@
  */
 
 #include "types.h"
+#ifdef __ARM11__
+#include "kernel.h"
+#endif // #ifdef __ARM11__
 
 
 #ifdef __cplusplus
@@ -56,7 +59,9 @@ enum
 	SDMMC_ERR_SET_BLOCKLEN     = 24u, // SET_BLOCKLEN CMD error.
 	SDMMC_ERR_LOCK_UNLOCK      = 25u, // LOCK_UNLOCK CMD error.
 	SDMMC_ERR_LOCK_UNLOCK_FAIL = 26u, // Lock/unlock operation failed (R1 status).
-	SDMMC_ERR_SLEEP_AWAKE      = 27u  // (e)MMC SLEEP_AWAKE CMD error.
+	SDMMC_ERR_SLEEP_AWAKE      = 27u, // (e)MMC SLEEP_AWAKE CMD error.
+	SDMMC_ERR_ERASE            = 28u, // Erase/TRIM CMD error or timeout.
+	SDMMC_ERR_NOT_SUPPORTED    = 29u  // The device doesn't support the operation.
 };
 
 // (e)MMC/SD device numbers.
@@ -76,6 +81,10 @@ enum
 #define SDMMC_PROT_PERM      BIT(2) // Permanent write protection (CSD).
 #define SDMMC_PROT_PASSWORD  BIT(3) // (e)MMC/SD card is password protected.
 
+// Bus speed modes for SdmmcInfo.busMode and SDMMC_setBusMode().
+#define SDMMC_BUS_MODE_DEFAULT  (0u) // Default speed.
+#define SDMMC_BUS_MODE_HS       (1u) // High speed (SD CMD6 or (e)MMC HS_TIMING).
+
 typedef struct
 {
 	u8 type;     // 0 = none, 1 = (e)MMC, 2 = High capacity (e)MMC, 3 = SDSC, 4 = SDHC/SDXC, 5 = SDUC.
@@ -86,6 +95,8 @@ typedef struct
 	u32 cid[4];  // Raw CID without the CRC.
 	u16 ccc;     // (e)MMC/SD command class support from CSD. One per bit starting at 0.
 	u8 busWidth; // The current bus width used to talk to the card.
+	u32 auSize;  // SD allocation unit size in 512 byte units. 0 = unknown or (e)MMC.
+	u8 busMode;  // See SDMMC_BUS_MODE_... defines above.
 } SdmmcInfo;
 
 typedef struct
@@ -98,6 +109,61 @@ typedef struct
 	u16 count;   // Number of blkSize blocks to transfer.
 } MmcCommand;
 
+// Transfer statistics. Only collected with TMIO_STATS enabled (see tmio_config.h).
+// Latencies are in TMIO_STATS_TICK_FREQ ticks. Histogram bucket i counts
+// latencies in the range [2^i, 2^(i+1)). The last bucket also holds everything above.
+#define SDMMC_STATS_HIST_BUCKETS  (24u)
+
+typedef struct
+{
+	u32 reads;          // Read transfers including async requests.
+	u32 writes;         // Write transfers including async requests.
+	u64 sectorsRead;    // Sectors read successfully.
+	u64 sectorsWritten; // Sectors written successfully.
+	u32 readErrors;     // Failed read transfers.
+	u32 writeErrors;    // Failed write transfers.
+	u32 retries;        // Transfers retried after a CRC error in high speed mode.
+	u32 readHist[SDMMC_STATS_HIST_BUCKETS];  // Read transfer latency.
+	u32 writeHist[SDMMC_STATS_HIST_BUCKETS]; // Write transfer latency.
+	u32 sleeps;         // Sleep entries via SDMMC_setSleepMode() or the idle timeout.
+	u32 wakes;          // Wake ups including the async ones.
+	u32 asyncWakes;     // Wake ups done by the async queue without blocking the caller.
+	u64 asleepTicks;    // Time spent asleep in TMIO_STATS_TICK_FREQ ticks. See SDMMC_getStats().
+} SdmmcStats;
+
+// Idle clock for the idle timeout. See tmio_config.h.
+#ifdef __ARM9__
+#define SDMMC_IDLE_TICK_FREQ  (1u)                // Timer 2 IRQ. Only runs while a device with idle timeout is awake.
+#elif __ARM11__
+#define SDMMC_IDLE_TICK_FREQ  (268111856u / 64)   // CCNT with divider 64.
+#endif // #ifdef __ARM9__
+
+// Operations for SdmmcReq.op.
+enum
+{
+	SDMMC_REQ_READ  = 0u, // Read sectors.
+	SDMMC_REQ_WRITE = 1u  // Write sectors.
+};
+
+// Async sector read/write request. Owned by the caller and must
+// stay valid until the request completed.
+typedef struct SdmmcReq SdmmcReq;
+struct SdmmcReq
+{
+	SdmmcReq *next;  // Internal. Next request in the device queue.
+	u32 sect;        // Start sector.
+	void *buf;       // Data buffer. NULL for DMA (set up the DMA before submitting to an idle queue).
+	u16 count;       // Number of sectors to transfer.
+	u8 op;           // See SDMMC_REQ_... above.
+	u8 devNum;       // Internal. Set by SDMMC_submitRequest().
+	au8 done;        // Internal. Use SDMMC_pollRequest().
+	u32 res;         // Result. Valid once the request completed.
+	u32 startTicks;  // Internal. Statistics timestamp of the transfer start.
+#ifdef __ARM11__
+	KHandle event;   // Optional kernel event signaled on completion. 0 for none.
+#endif // #ifdef __ARM11__
+};
+
 // Mode bits for SDMMC_lockUnlock().
 #define SDMMC_LK_CLR_PWD  BIT(1) // Clear password.
 #define SDMMC_LK_UNLOCK   (0u)   // Unlock.
@@ -120,6 +186,7 @@ u32 SDMMC_init(const u8 devNum);
 /**
  * @brief      Switches a (e)MMC/SD card device between sleep/awake mode.
  *             Note that SD cards don't have a true sleep mode.
+ *             Sleeping devices are woken up automatically on the next access.
  *
  * @param[in]  devNum   The device.
  * @param[in]  enabled  The mode. true to enable sleep and false to wake up.
@@ -129,6 +196,59 @@ u32 SDMMC_init(const u8 devNum);
  */
 u32 SDMMC_setSleepMode(const u8 devNum, const bool enabled);
 
+/**
+ * @brief      Sets the inactivity timeout after which SDMMC_pollIdle()
+ *             puts a (e)MMC/SD card device to sleep. Rounded up to
+ *             SDMMC_IDLE_TICK_FREQ ticks. See SDMMC_setIdleHandler() on ARM9.
+ *
+ * @param[in]  devNum     The device.
+ * @param[in]  timeoutMs  The timeout in milliseconds. 0 disables the idle policy.
+ *                        At least 8 minutes are supported.
+ *
+ * @return     Returns SDMMC_ERR_NONE on success or
+ *             SDMMC_ERR_INVAL_PARAM on failure.
+ */
+u32 SDMMC_setIdleTimeout(const u8 devNum, const u32 timeoutMs);
+
+/**
+ * @brief      Puts a (e)MMC/SD card device to sleep if it was idle for longer than
+ *             the timeout set with SDMMC_setIdleTimeout(). Call this periodically
+ *             or from the idle handler. Requests wake the device up again. Async
+ *             requests do so from the tmio ISR without blocking the caller.
+ *
+ * @param[in]  devNum  The device.
+ *
+ * @return     Returns SDMMC_ERR_NONE on success or
+ *             one of the errors listed above on failure.
+ */
+u32 SDMMC_pollIdle(const u8 devNum);
+
+#ifdef __ARM9__
+typedef void (*SdmmcIdleHandler)(void);
+
+/**
+ * @brief      Sets the function the idle clock IRQ calls once a device was idle
+ *             for longer than its timeout. It runs in interrupt context and
+ *             should call SDMMC_pollIdle() unless other code is using the devices.
+ *             It's called again every second until the devices are asleep.
+ *
+ * @param[in]  handler  The handler. NULL to poll manually.
+ */
+void SDMMC_setIdleHandler(SdmmcIdleHandler handler);
+#endif // #ifdef __ARM9__
+
+/**
+ * @brief      Changes the bus speed mode of a (e)MMC/SD card device.
+ *             High speed is only possible if the card switched to it during init.
+ *
+ * @param[in]  devNum  The device.
+ * @param[in]  mode    The mode. See SDMMC_BUS_MODE_... defines.
+ *
+ * @return     Returns SDMMC_ERR_NONE on success or
+ *             one of the errors listed above on failure.
+ */
+u32 SDMMC_setBusMode(const u8 devNum, const u8 mode);
+
 /**
  * @brief      Deinitializes a (e)MMC/SD card device.
  *
@@ -183,6 +303,19 @@ u32 SDMMC_importDevState(const u8 devNum, const u8 devIn[64]);
 u32 SDMMC_importHosEmmcState(void);
 #endif // #ifdef __ARM9__
 
+/**
+ * @brief      Checks if an initialized device can still be used. Fails if the
+ *             SD card was removed or inserted since init/import or if the device
+ *             doesn't respond in transfer state. Used to reattach a device
+ *             after SDMMC_importDevState(). On failure the device is deinitialized.
+ *
+ * @param[in]  devNum  The device.
+ *
+ * @return     Returns SDMMC_ERR_NONE on success or
+ *             one of the errors listed above on failure.
+ */
+u32 SDMMC_verifyDevState(const u8 devNum);
+
 /**
  * @brief      Outputs infos about a (e)MMC/SD card device.
  *
@@ -257,6 +390,40 @@ u32 SDMMC_writeSectors(const u8 devNum, u32 sect, const void *const buf, const u
  */
 u32 SDMMC_sendCommand(const u8 devNum, MmcCommand *const mmcCmd);
 
+/**
+ * @brief      Queues an async sector read/write request for a (e)MMC/SD card device.
+ *             Requests are processed in order and serviced from the tmio ISR.
+ *             The synchronous functions above wait for the queue to drain first.
+ *             Devices on the same controller (TMIO_CARD_PORT 0) share one queue.
+ *
+ * @param[in]  devNum  The device.
+ * @param      req     The request. Must stay valid until the request completed.
+ *
+ * @return     Returns SDMMC_ERR_NONE on success or
+ *             one of the errors listed above on failure.
+ */
+u32 SDMMC_submitRequest(const u8 devNum, SdmmcReq *const req);
+
+/**
+ * @brief      Checks if an async request completed. Not safe to call from interrupt context.
+ *
+ * @param      req   The request.
+ *
+ * @return     Returns true if the request completed. The result is in req->res.
+ */
+bool SDMMC_pollRequest(SdmmcReq *const req);
+
+/**
+ * @brief      Waits for an async request to complete. On ARM11 this blocks on
+ *             req->event if set. Otherwise the CPU sleeps until the next interrupt.
+ *
+ * @param      req   The request.
+ *
+ * @return     Returns SDMMC_ERR_NONE on success or
+ *             one of the errors listed above on failure.
+ */
+u32 SDMMC_waitRequest(SdmmcReq *const req);
+
 /**
  * @brief      Returns the R1 card status for a previously failed read/write/custom command.
  *
@@ -266,7 +433,44 @@ u32 SDMMC_sendCommand(const u8 devNum, MmcCommand *const mmcCmd);
  */
 u32 SDMMC_getLastR1error(const u8 devNum);
 
-// TODO: TRIM/erase support.
+/**
+ * @brief      Tells a (e)MMC/SD card device that sectors are no longer in use.
+ *             Uses TRIM on (e)MMC and erase on SD cards. The content of
+ *             the sectors is undefined afterwards. SDSC cards without ERASE_BLK_EN
+ *             are not supported. Blocks until done which can take up to 3 seconds
+ *             per 4 MiB on slow cards.
+ *
+ * @param[in]  devNum  The device.
+ * @param[in]  sect    The start sector.
+ * @param[in]  count   The number of sectors.
+ *
+ * @return     Returns SDMMC_ERR_NONE on success or
+ *             one of the errors listed above on failure.
+ */
+u32 SDMMC_eraseSectors(const u8 devNum, u32 sect, u32 count);
+
+/**
+ * @brief      Outputs the transfer statistics of a (e)MMC/SD card device.
+ *             All zero if TMIO_STATS is disabled.
+ *             Use TMIO_getStats() for per command statistics.
+ *             The stats clock wraps around after about 68 (ARM9) or 17 (ARM11) minutes.
+ *             Call this or SDMMC_pollIdle() more often while a device sleeps.
+ *
+ * @param[in]  devNum    The device.
+ * @param      statsOut  A pointer to a SdmmcStats struct.
+ *
+ * @return     Returns SDMMC_ERR_NONE on success or SDMMC_ERR_INVAL_PARAM on failure.
+ */
+u32 SDMMC_getStats(const u8 devNum, SdmmcStats *const statsOut);
+
+/**
+ * @brief      Resets the transfer statistics of a (e)MMC/SD card device.
+ *
+ * @param[in]  devNum  The device.
+ *
+ * @return     Returns SDMMC_ERR_NONE on success or SDMMC_ERR_INVAL_PARAM on failure.
+ */
+u32 SDMMC_resetStats(const u8 devNum);
 
 #ifdef __cplusplus
 } // extern "C"
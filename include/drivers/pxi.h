@@ -101,6 +101,10 @@ ALWAYS_INLINE Pxi* getPxiRegs(void)
 void PXI_init(void);
 void PXI_deinit(void);
 u32 PXI_sendCmd(u32 cmd, const u32 *buf, u32 words);
+#ifdef __ARM9__
+// While enabled incoming commands are held back. Disabling runs a held back command.
+void PXI_setDeferCmds(const bool defer);
+#endif // #ifdef __ARM9__
 
 #ifdef __cplusplus
 } // extern "C"
@@ -20,6 +20,9 @@
 
 #include "types.h"
 #include "mem_map.h"
+#ifdef __ARM11__
+#include "kernel.h"
+#endif // #ifdef __ARM11__
 
 
 #ifdef __cplusplus
@@ -323,6 +326,32 @@ typedef struct
 	u32 resp[4];     // Little endian, MSB first.
 } TmioPort;
 
+// Completion callback for TMIO_startCommand(). Called from the tmio ISR.
+// res is 0 on success otherwise see REG_SD_STATUS1/2 bits.
+typedef void (*TmioCallback)(TmioPort *const port, const u32 res);
+
+// Card insert/remove callback. Called from the tmio ISR.
+typedef void (*TmioCardCallback)(const bool inserted);
+
+// Statistics. Only collected with TMIO_STATS enabled (see tmio_config.h).
+// Latencies are in TMIO_STATS_TICK_FREQ ticks. Histogram bucket i counts
+// latencies in the range [2^i, 2^(i+1)). The last bucket also holds everything above.
+#ifdef __ARM9__
+#define TMIO_STATS_TICK_FREQ     (67027964u / 64)  // ARM9 timer 0 + 1 cascade.
+#elif __ARM11__
+#define TMIO_STATS_TICK_FREQ     (268111856u / 64) // CCNT with divider 64.
+#endif // #ifdef __ARM9__
+#define TMIO_STATS_HIST_BUCKETS  (24u)
+
+typedef struct
+{
+	u32 cmdCount[128];  // Commands sent. Index is the command index. +64 for ACMDs.
+	u32 cmdErrors[128]; // Commands which failed. Same index as cmdCount.
+	u32 latencyHist[TMIO_STATS_HIST_BUCKETS]; // Latency from command start to data end.
+	u64 bytesRead;      // Bytes moved by successful data read commands.
+	u64 bytesWritten;   // Bytes moved by successful data write commands.
+} TmioStats;
+
 
 
 /**
@@ -350,6 +379,31 @@ void TMIO_initPort(TmioPort *const port, const u8 portNum);
  */
 bool TMIO_cardDetected(void);
 
+/**
+ * @brief      Returns the number of card insert and remove events since TMIO_init().
+ *             A changed value means the card may have been swapped.
+ *
+ * @return     The event count. Wraps around.
+ */
+u32 TMIO_getCardChanges(void);
+
+/**
+ * @brief      Sets a callback for card insert/remove events.
+ *
+ * @param[in]  cb    The callback. Called in interrupt context. NULL to disable.
+ */
+void TMIO_setCardCallback(TmioCardCallback cb);
+
+#ifdef __ARM11__
+/**
+ * @brief      Binds a kernel event which is signaled on card insert/remove.
+ *             Use TMIO_cardDetected() to get the new state.
+ *
+ * @param[in]  event  The kernel event. 0 to unbind.
+ */
+void TMIO_bindCardEvent(const KHandle event);
+#endif // #ifdef __ARM11__
+
 /**
  * @brief      Checks if the write protect slider is set to locked.
  *
@@ -375,6 +429,56 @@ void TMIO_powerupSequence(TmioPort *const port);
  */
 u32 TMIO_sendCommand(TmioPort *const port, const u16 cmd, const u32 arg);
 
+/**
+ * @brief      Starts a command and returns immediately. The tmio ISR handles
+ *             the response and CPU data transfers and calls cb when done.
+ *             Only one command per controller can be active at a time and
+ *             TMIO_sendCommand() must not be used on the same controller
+ *             until the callback fired.
+ *
+ * @param      port  A pointer to the port struct. Must stay valid until cb is called.
+ * @param[in]  cmd   The command.
+ * @param[in]  arg   The argument for the command.
+ * @param[in]  cb    The completion callback. Called in interrupt context.
+ */
+void TMIO_startCommand(TmioPort *const port, const u16 cmd, const u32 arg, TmioCallback cb);
+
+/**
+ * @brief      Returns the current statistics timestamp.
+ *
+ * @return     The timestamp in TMIO_STATS_TICK_FREQ ticks. Wraps around.
+ */
+u32 TMIO_getStatsTicks(void);
+
+/**
+ * @brief      Outputs the command statistics for the controller a port belongs to.
+ *             All zero if TMIO_STATS is disabled.
+ *
+ * @param[in]  portNum   The port number.
+ * @param      statsOut  A pointer to a TmioStats struct.
+ */
+void TMIO_getStats(const u8 portNum, TmioStats *const statsOut);
+
+/**
+ * @brief      Resets the command statistics for the controller a port belongs to.
+ *
+ * @param[in]  portNum  The port number.
+ */
+void TMIO_resetStats(const u8 portNum);
+
+/**
+ * @brief      Returns the latency histogram bucket for a tick count.
+ *
+ * @param[in]  ticks  The latency in TMIO_STATS_TICK_FREQ ticks.
+ *
+ * @return     The bucket index.
+ */
+ALWAYS_INLINE u32 TMIO_statsBucket(const u32 ticks)
+{
+	const u32 bucket = 31u - __builtin_clz(ticks | 1u);
+	return (bucket < TMIO_STATS_HIST_BUCKETS ? bucket : TMIO_STATS_HIST_BUCKETS - 1);
+}
+
 /**
  * @brief      Sets the clock for a tmio port.
  *
@@ -50,8 +50,22 @@ extern "C"
 #elif __ARM11__
 #define TMIO_CARD_PORT  (2u) // Port 2 only. Do not change.
 #define TMIO_eMMC_PORT  (3u) // Placeholder. Do not change. Not connected/accessible.
+#define TMIO_USE_CDMA   (1u) // Use CDMA for data transfers on controller 2 (physical 3). 0 = CPU only.
 #endif // #ifdef __ARM9__
 
+// Collect command and transfer statistics. 0 = disabled. See TMIO_getStats().
+// The timestamps need a free running timer which is reserved while enabled:
+// ARM9:  Timer 0 and 1 (cascaded). Don't use them elsewhere. TMIO_deinit() stops them.
+// ARM11: Performance monitor cycle counter. The divider is forced to 64
+//        which breaks perfMonitorCountCycles() users.
+#define TMIO_STATS      (0u)
+
+// The sdmmc idle timeout (SDMMC_setIdleTimeout(), DISKIO_IDLE_TIMEOUT_MS in diskio.c)
+// needs a clock too. Nothing is reserved while no timeout is set:
+// ARM9:  Timer 2 and its IRQ. Only runs while a device with idle timeout is awake.
+//        One IRQ per second. Don't use them elsewhere.
+// ARM11: Performance monitor cycle counter with divider 64. No IRQ.
+
 
 
 // Don't modify anything below!
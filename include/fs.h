@@ -28,34 +28,72 @@ extern "C"
 {
 #endif
 
+// The functions can be called from any ARM11 task but they are fully serialized.
+// Only one PXI command is in flight at a time, so calls from different tasks
+// wait for each other even for different files and drives. Concurrent access
+// (per-volume locks, multiple commands in flight) is not implemented.
+// On the ARM9 all volumes share one lock and a busy lock never makes a call
+// wait. Local calls fail with FR_TIMEOUT. ARM11 commands are held back and
+// run when the lock is released, so long local operations delay them.
 #define FS_MAX_DRIVES   (FF_VOLUMES)
-#define FS_DRIVE_NAMES  "sdmc:/"
-#define FS_MAX_FILES    (1u)
-#define FS_MAX_DIRS     (1u)
+#define FS_DRIVE_NAMES  "sdmc:/", "nand:/"
+
+// Extra fOpen() mode flag. Builds a cluster link map so fLseek() doesn't have
+// to walk the FAT chain. The map is dropped when a write or seek grows the file.
+#define FS_OPEN_FASTSEEK  (0x80u)
+
+// Flags for fAllocate(). Reserves a contiguous area for an empty file opened for writing.
+#define FS_ALLOC_PREPARE  (0u) // Only reserve the area. Following writes fill it without FAT chain walks.
+#define FS_ALLOC_NOW      (1u) // Allocate right away. The file size is set to the allocated size.
 
 
 typedef enum
 {
-	FS_DRIVE_SDMC = 0u
+	FS_DRIVE_SDMC = 0u,
+	// Builtin eMMC. Unencrypted FAT images only! On retail consoles the eMMC has a
+	// NCSD header and encrypted partitions so fMount() fails. Never call
+	// fDiscardFree() on it unless the eMMC really holds such an image.
+	FS_DRIVE_NAND = 1u
 } FsDrive;
 
+// File and dir handles are not reused right away. A closed handle stays invalid.
 typedef u32 FHandle;
 typedef u32 DHandle;
 
+// Statistics for a single file handle. See fGetStats().
+typedef struct
+{
+	u64 bytesRead;
+	u64 bytesWritten;
+	u32 seeks;
+} FsFileStats;
+
+// Path lookup cache statistics. See fGetPathCacheStats().
+typedef struct
+{
+	u32 lookups;
+	u32 hits;
+	u32 invalidations; // Including the ones caused by SD card remove/insert events.
+} FsPathCacheStats;
+
 
 
 Result fMount(FsDrive drive);
 Result fUnmount(FsDrive drive);
 Result fGetFree(FsDrive drive, u64 *const size);
+Result fDiscardFree(FsDrive drive);
 Result fOpen(FHandle *const hOut, const char *const path, u8 mode);
 Result fRead(FHandle h, void *const buf, u32 size, u32 *const bytesRead);
 Result fWrite(FHandle h, const void *const buf, u32 size, u32 *const bytesWritten);
 Result fSync(FHandle h);
-Result fLseek(FHandle h, u32 off);
-u32    fTell(FHandle h);
-u32    fSize(FHandle h);
+Result fAllocate(FHandle h, u64 size, u8 flags);
+Result fLseek(FHandle h, u64 off);
+u64    fTell(FHandle h);
+u64    fSize(FHandle h);
+Result fGetStats(FHandle h, FsFileStats *const stats);
 Result fClose(FHandle h);
 Result fStat(const char *const path, FILINFO *const fi);
+Result fGetPathCacheStats(FsPathCacheStats *const stats);
 Result fChdir(const char *const path);
 Result fOpenDir(DHandle *const hOut, const char *const path);
 Result fReadDir(DHandle h, FILINFO *const fi, u32 num, u32 *const entriesRead);
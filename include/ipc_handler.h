@@ -50,9 +50,9 @@ typedef enum
 	IPC_CMD9_FREAD           = MAKE_CMD9(0, 2, 1),
 	IPC_CMD9_FWRITE          = MAKE_CMD9(1, 1, 1),
 	IPC_CMD9_FSYNC           = MAKE_CMD9(0, 0, 1),
-	IPC_CMD9_FLSEEK          = MAKE_CMD9(0, 0, 2),
-	IPC_CMD9_FTELL           = MAKE_CMD9(0, 0, 1),
-	IPC_CMD9_FSIZE           = MAKE_CMD9(0, 0, 1),
+	IPC_CMD9_FLSEEK          = MAKE_CMD9(0, 0, 3),
+	IPC_CMD9_FTELL           = MAKE_CMD9(0, 1, 1),
+	IPC_CMD9_FSIZE           = MAKE_CMD9(0, 1, 1),
 	IPC_CMD9_FCLOSE          = MAKE_CMD9(0, 0, 1),
 	IPC_CMD9_FSTAT           = MAKE_CMD9(1, 1, 0),
 	IPC_CMD9_FCHDIR          = MAKE_CMD9(1, 0, 0),
@@ -62,6 +62,10 @@ typedef enum
 	IPC_CMD9_FMKDIR          = MAKE_CMD9(1, 0, 0),
 	IPC_CMD9_FRENAME         = MAKE_CMD9(2, 0, 0),
 	IPC_CMD9_FUNLINK         = MAKE_CMD9(1, 0, 0),
+	IPC_CMD9_FDISCARD_FREE   = MAKE_CMD9(0, 0, 1),
+	IPC_CMD9_FALLOCATE       = MAKE_CMD9(0, 0, 4),
+	IPC_CMD9_FGET_STATS      = MAKE_CMD9(0, 1, 1),
+	IPC_CMD9_FPATH_STATS     = MAKE_CMD9(0, 1, 0),
 
 	// open_agb_firm specific API.
 	IPC_CMD9_PREPARE_GBA     = MAKE_CMD9(1, 0, 2),
@@ -23,12 +23,35 @@
 
 /*
  * Maximum number of objects we can create (Slabheap).
+ * The slabheaps grow on demand. 0 means no limit.
 */
-#define MAX_TASKS        (4) // Including main and idle task.
-#define MAX_EVENTS       (16)
-#define MAX_MUTEXES      (8)
-#define MAX_SEMAPHORES   (2)
+#ifndef MAX_TASKS
+#define MAX_TASKS        (0) // Including main and idle task.
+#endif
+#ifndef MAX_EVENTS
+#define MAX_EVENTS       (0)
+#endif
+#ifndef MAX_EVENT_GROUPS
+#define MAX_EVENT_GROUPS (0)
+#endif
+#ifndef MAX_MUTEXES
+#define MAX_MUTEXES      (0)
+#endif
+#ifndef MAX_SEMAPHORES
+#define MAX_SEMAPHORES   (0)
+#endif
+#ifndef MAX_CONDVARS
+#define MAX_CONDVARS     (0)
+#endif
+#ifndef MAX_RWLOCKS
+#define MAX_RWLOCKS      (0)
+#endif
+#ifndef MAX_TIMERS
 #define MAX_TIMERS       (0)
+#endif
+#ifndef MAX_WORK_QUEUES
+#define MAX_WORK_QUEUES  (0)
+#endif
 
 #define IDLE_STACK_SIZE  (0x1000) // Keep in mind this stack is used in interrupt contex! TODO: Change this.
 
@@ -38,3 +61,6 @@
 #if (MAX_PRIO_BITS < 3 || MAX_PRIO_BITS > 32)
 	#error "Invalid number of maximum task priorities!"
 #endif
+#if (MAX_TASKS != 0 && MAX_TASKS < 2)
+	#error "MAX_TASKS must include the main and idle task!"
+#endif
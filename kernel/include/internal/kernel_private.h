@@ -43,6 +43,7 @@ struct TaskCb
 	KRes res; // Last error code. Also abused for taskArg.
 	uintptr_t savedSp;
 	void *stack;
+	void *waitData; // Object specific data while blocked. See waitQueueBlockWithData().
 	// Name?
 	// Exit code?
 }; // Task context
@@ -53,7 +54,13 @@ static_assert(offsetof(TaskCb, node) == 0, "Error: Member node of TaskCb is not
 
 const TaskCb* getCurrentTask(void);
 KRes waitQueueBlock(ListNode *waitQueue);
+KRes waitQueueBlockPrio(ListNode *waitQueue);
+KRes waitQueueBlockWithData(ListNode *waitQueue, void *waitData);
 bool waitQueueWakeN(ListNode *waitQueue, u32 wakeCount, KRes res, bool reschedule);
+// Same as waitQueueWakeN() but never reschedules and keeps the kernel lock.
+bool waitQueueWakeNLocked(ListNode *waitQueue, u32 wakeCount, KRes res);
+// Wakes a specific task blocked on a wait queue. Never reschedules and keeps the kernel lock.
+void waitQueueWakeTaskLocked(TaskCb *task, KRes res);
 
 
 static inline void kernelLock(void)
@@ -73,4 +80,9 @@ static inline void kernelUnlock(void)
 void _eventSlabInit(void);
 void _mutexSlabInit(void);
 void _semaphoreSlabInit(void);
+void _condVarSlabInit(void);
+void _rwLockSlabInit(void);
+void _eventGroupSlabInit(void);
+KRes _mutexReleaseLocked(KHandle const kmutex);
+void _workQueueSlabInit(void);
 void _timerInit(void);
\ No newline at end of file
@@ -27,25 +27,35 @@ extern "C"
 {
 #endif
 
-typedef ListNode SlabHeap;
+// Slabheaps start empty and grow in SLAB_CHUNK_SIZE steps on demand.
+#define SLAB_CHUNK_SIZE  (0x1000u)
+
+typedef struct
+{
+	ListNode freeList;
+	size_t objSize;
+	size_t num;    // Number of object slots allocated so far.
+	size_t maxNum; // Hard limit. 0 = no limit.
+} SlabHeap;
 
 
 
 /**
- * @brief      Initializes the slabheap.
+ * @brief      Initializes the slabheap. No memory is allocated until the first slabAlloc().
  *
  * @param      slab     SlabHeap object pointer.
  * @param[in]  objSize  The size of the object slots.
- * @param[in]  num      The maximum number of object slots.
+ * @param[in]  maxNum   The maximum number of object slots. 0 for no limit.
  */
-void slabInit(SlabHeap *slab, size_t objSize, size_t num);
+void slabInit(SlabHeap *slab, size_t objSize, size_t maxNum);
 
 /**
  * @brief      Allocates an object slot from the slabheap.
+ *             Grows the slabheap by one chunk if there are no free slots left.
  *
  * @param      slab  SlabHeap object pointer.
  *
- * @return     Returns a pointer to the object slot.
+ * @return     Returns a pointer to the object slot or NULL if out of memory or the limit is reached.
  */
 void* slabAlloc(SlabHeap *slab);
 
@@ -55,7 +65,7 @@ void* slabAlloc(SlabHeap *slab);
  * @param      slab     SlabHeap object pointer.
  * @param[in]  clrSize  The clear size (passed to memset()).
  *
- * @return     Returns a pointer to the object slot.
+ * @return     Returns a pointer to the object slot or NULL if out of memory or the limit is reached.
  */
 void* slabCalloc(SlabHeap *slab, size_t clrSize);
 
@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kernel.h"
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief      Creates a new kernel condition variable.
+ *
+ * @return     The KHandle of the condition variable or NULL on error.
+ */
+KHandle createCondVar(void);
+
+/**
+ * @brief      Deletes a kernel condition variable.
+ *
+ * @param[in]  kcondvar  The KHandle of the condition variable.
+ */
+void deleteCondVar(KHandle const kcondvar);
+
+/**
+ * @brief      Atomically unlocks the mutex and waits for the condition variable to be signaled.
+ *             The mutex is locked again before returning. Always recheck the condition after wakeup.
+ *
+ * @param[in]  kcondvar  The KHandle of the condition variable.
+ * @param[in]  kmutex    The KHandle of the mutex. Must be locked by the current task.
+ *
+ * @return     Returns the result. See Kres in kernel.h.
+ */
+KRes waitForCondVar(KHandle const kcondvar, KHandle const kmutex);
+
+/**
+ * @brief      Wakes up one task waiting on the condition variable.
+ *
+ * @param[in]  kcondvar    The KHandle of the condition variable.
+ * @param[in]  reschedule  Set to true to immediately reschedule.
+ */
+void signalCondVar(KHandle const kcondvar, bool reschedule);
+
+/**
+ * @brief      Wakes up all tasks waiting on the condition variable.
+ *
+ * @param[in]  kcondvar    The KHandle of the condition variable.
+ * @param[in]  reschedule  Set to true to immediately reschedule.
+ */
+void broadcastCondVar(KHandle const kcondvar, bool reschedule);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
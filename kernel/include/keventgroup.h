@@ -0,0 +1,107 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include "kernel.h"
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// waitForEventGroup() mode flags.
+#define EVENT_GROUP_WAIT_ANY    (0u)    // Wake up if any flag in the mask is set.
+#define EVENT_GROUP_WAIT_ALL    (1u)    // Wake up only if all flags in the mask are set.
+#define EVENT_GROUP_AUTO_CLEAR  (1u<<1) // Clear the matched flags on wakeup.
+
+
+
+/**
+ * @brief      Creates a new kernel event group (32 flags).
+ *
+ * @param[in]  flags  The initial flags.
+ *
+ * @return     The KHandle for the event group or NULL on error.
+ */
+KHandle createEventGroup(uint32_t flags);
+
+/**
+ * @brief      Deletes a kernel event group.
+ *
+ * @param[in]  kgroup  The KHandle of the event group to delete.
+ */
+void deleteEventGroup(KHandle const kgroup);
+
+/**
+ * @brief      Binds an interrupt to flags of a kernel event group.
+ *             The flags are set each time the interrupt fires.
+ *
+ * @param[in]  kgroup  The KHandle of the event group.
+ * @param[in]  flags   The flags to set.
+ * @param[in]  id      The interrupt id.
+ * @param[in]  prio    The interrupt priority.
+ */
+void bindInterruptToEventGroup(KHandle const kgroup, uint32_t flags, uint8_t id, uint8_t prio);
+
+void unbindInterruptEventGroup(uint8_t id);
+
+/**
+ * @brief      Waits for flags of a kernel event group.
+ *
+ * @param[in]  kgroup  The KHandle of the event group.
+ * @param[in]  mask    The flags to wait for. Must not be 0.
+ * @param[in]  mode    EVENT_GROUP_WAIT_ANY or EVENT_GROUP_WAIT_ALL optionally combined with EVENT_GROUP_AUTO_CLEAR.
+ * @param      flags   Optional output for the flags at wakeup time (before auto clear). Can be NULL.
+ *
+ * @return     Returns the result. See Kres in kernel.h.
+ */
+KRes waitForEventGroup(KHandle const kgroup, uint32_t mask, uint32_t mode, uint32_t *const flags);
+
+/**
+ * @brief      Sets flags of a kernel event group. Safe to call from ISRs with reschedule false.
+ *
+ * @param[in]  kgroup      The KHandle of the event group.
+ * @param[in]  flags       The flags to set.
+ * @param[in]  reschedule  Set to true to immediately reschedule.
+ */
+void setEventGroupFlags(KHandle const kgroup, uint32_t flags, bool reschedule);
+
+/**
+ * @brief      Clears flags of a kernel event group. Safe to call from ISRs.
+ *
+ * @param[in]  kgroup  The KHandle of the event group.
+ * @param[in]  flags   The flags to clear.
+ */
+void clearEventGroupFlags(KHandle const kgroup, uint32_t flags);
+
+/**
+ * @brief      Returns the current flags of a kernel event group.
+ *
+ * @param[in]  kgroup  The KHandle of the event group.
+ *
+ * @return     The flags.
+ */
+uint32_t getEventGroupFlags(KHandle const kgroup);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,86 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kernel.h"
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Many readers or a single writer. Waiting writers block new readers
+// and unlocking a writer prefers waiting readers so neither side starves.
+
+/**
+ * @brief      Creates a new kernel reader-writer lock.
+ *
+ * @return     The KHandle of the reader-writer lock or NULL on error.
+ */
+KHandle createRwLock(void);
+
+/**
+ * @brief      Deletes a kernel reader-writer lock.
+ *
+ * @param[in]  krwlock  The KHandle of the reader-writer lock.
+ */
+void deleteRwLock(KHandle const krwlock);
+
+/**
+ * @brief      Locks a kernel reader-writer lock for reading (shared).
+ *
+ * @param[in]  krwlock  The KHandle of the reader-writer lock.
+ *
+ * @return     Returns the result. See Kres in kernel.h.
+ */
+KRes lockRwLockRead(KHandle const krwlock);
+
+/**
+ * @brief      Unlocks a kernel reader-writer lock locked for reading.
+ *
+ * @param[in]  krwlock  The KHandle of the reader-writer lock.
+ *
+ * @return     Returns KRES_NO_PERMISSIONS if the lock is not read locked. Otherwise KRES_OK.
+ */
+KRes unlockRwLockRead(KHandle const krwlock);
+
+/**
+ * @brief      Locks a kernel reader-writer lock for writing (exclusive).
+ *
+ * @param[in]  krwlock  The KHandle of the reader-writer lock.
+ *
+ * @return     Returns the result. See Kres in kernel.h.
+ */
+KRes lockRwLockWrite(KHandle const krwlock);
+
+/**
+ * @brief      Unlocks a kernel reader-writer lock locked for writing.
+ *
+ * @param[in]  krwlock  The KHandle of the reader-writer lock.
+ *
+ * @return     Returns KRES_NO_PERMISSIONS immediately if the current task
+ * @return     is not the writer. Otherwise KRES_OK.
+ */
+KRes unlockRwLockWrite(KHandle const krwlock);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
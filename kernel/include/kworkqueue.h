@@ -0,0 +1,85 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "kernel.h"
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef void (*WorkFunc)(void*);
+
+// Work item. Owned by the caller and must stay valid until the work function ran.
+typedef struct KWork KWork;
+struct KWork
+{
+	KWork *next;         // Internal. Don't touch.
+	atomic_bool pending; // Internal. Don't touch.
+	WorkFunc func;
+	void *arg;
+};
+
+#define KWORK_INIT_VAL(f, a)  ((KWork){NULL, false, (f), (a)})
+
+
+
+/**
+ * @brief      Creates a new work queue and starts its worker task.
+ *             Work queues can't be deleted.
+ *
+ * @param[in]  stackSize  The worker task stack size.
+ * @param[in]  priority   The worker task priority.
+ *
+ * @return     The KHandle of the work queue or NULL on error.
+ */
+KHandle createWorkQueue(size_t stackSize, uint8_t priority);
+
+/**
+ * @brief      Initializes a work item.
+ *
+ * @param      work  The work item.
+ * @param[in]  func  The function to run in the worker task.
+ * @param      arg   The argument passed to func.
+ */
+static inline void initWork(KWork *const work, WorkFunc func, void *arg)
+{
+	*work = KWORK_INIT_VAL(func, arg);
+}
+
+/**
+ * @brief      Queues a work item. Lock-free and safe to call from ISRs.
+ *             All items queued until the worker wakes up are run as one batch in queue order.
+ *
+ * @param[in]  kwq   The KHandle of the work queue.
+ * @param      work  The work item.
+ *
+ * @return     Returns false if the work item is already queued and hasn't run yet. Otherwise true.
+ */
+bool queueWork(KHandle const kwq, KWork *const work);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,97 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include "types.h"
+#include "kcondvar.h"
+#include "kmutex.h"
+#include "internal/list.h"
+#include "internal/kernel_private.h"
+#include "internal/util.h"
+#include "internal/slabheap.h"
+#include "internal/config.h"
+
+
+typedef struct
+{
+	ListNode waitQueue;
+} KCondVar;
+
+
+static SlabHeap g_condVarSlab = {0};
+
+
+
+void _condVarSlabInit(void)
+{
+	slabInit(&g_condVarSlab, sizeof(KCondVar), MAX_CONDVARS);
+}
+
+KHandle createCondVar(void)
+{
+	KCondVar *const condVar = (KCondVar*)slabAlloc(&g_condVarSlab);
+	if(condVar == NULL) return 0;
+
+	listInit(&condVar->waitQueue);
+
+	return (KHandle)condVar;
+}
+
+void deleteCondVar(KHandle const kcondvar)
+{
+	KCondVar *const condVar = (KCondVar*)kcondvar;
+
+	kernelLock();
+	waitQueueWakeN(&condVar->waitQueue, (u32)-1, KRES_HANDLE_DELETED, true);
+
+	slabFree(&g_condVarSlab, condVar);
+}
+
+KRes waitForCondVar(KHandle const kcondvar, KHandle const kmutex)
+{
+	KCondVar *const condVar = (KCondVar*)kcondvar;
+
+	// Releasing the mutex and blocking must happen under the same
+	// kernel lock or we could miss a signal in between.
+	kernelLock();
+	KRes res = _mutexReleaseLocked(kmutex);
+	if(UNLIKELY(res != KRES_OK))
+	{
+		kernelUnlock();
+		return res;
+	}
+	res = waitQueueBlockPrio(&condVar->waitQueue);
+
+	// Reacquire the mutex even if the condition variable was deleted
+	// so the caller can always unlock it.
+	const KRes lockRes = lockMutex(kmutex);
+
+	return (res != KRES_OK ? res : lockRes);
+}
+
+void signalCondVar(KHandle const kcondvar, bool reschedule)
+{
+	kernelLock();
+	waitQueueWakeN(&((KCondVar*)kcondvar)->waitQueue, 1, KRES_OK, reschedule);
+}
+
+void broadcastCondVar(KHandle const kcondvar, bool reschedule)
+{
+	kernelLock();
+	waitQueueWakeN(&((KCondVar*)kcondvar)->waitQueue, (u32)-1, KRES_OK, reschedule);
+}
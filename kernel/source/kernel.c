@@ -49,6 +49,10 @@ static void initKernelState(void)
 	_eventSlabInit();
 	_mutexSlabInit();
 	_semaphoreSlabInit();
+	_condVarSlabInit();
+	_rwLockSlabInit();
+	_eventGroupSlabInit();
+	_workQueueSlabInit();
 	//_timerInit();
 }
 
@@ -161,6 +165,58 @@ KRes waitQueueBlock(ListNode *waitQueue)
 	return scheduler(TASK_STATE_BLOCKED);
 }
 
+// Inserts the current task behind all waiters with the same or higher priority.
+// Since tasks are woken from the front this gives priority order and FIFO order
+// for tasks with the same priority.
+KRes waitQueueBlockPrio(ListNode *waitQueue)
+{
+	TaskCb *const curTask = g_curTask;
+	const u8 curPrio = curTask->prio;
+
+	ListNode *pos = waitQueue->next;
+	while(pos != waitQueue && LIST_ENTRY(pos, TaskCb, node)->prio >= curPrio) pos = pos->next;
+	listAddBefore(pos, &curTask->node);
+
+	return scheduler(TASK_STATE_BLOCKED);
+}
+
+KRes waitQueueBlockWithData(ListNode *waitQueue, void *waitData)
+{
+	g_curTask->waitData = waitData;
+	return waitQueueBlock(waitQueue);
+}
+
+static u32 wakeTasks(ListNode *waitQueue, u32 wakeCount, KRes res)
+{
+	u32 readyBitmap = 0;
+	ListNode *const runQueues = g_runQueues;
+	ListNode *lastWoken[MAX_PRIO_BITS];
+	do
+	{
+		/*
+		 * Tasks are always taken from the front of the wait queue.
+		 * waitQueueBlock() appends so waiters are woken in FIFO order.
+		 * waitQueueBlockPrio() keeps the queue sorted by priority.
+		 *
+		 * Edge case:
+		 * 2 tasks, 1 single shot event. Task 2 waits first and then task 1.
+		 * When signaled (by an IRQ) only task 1 will ever run instead of
+		 * alternating between both if we took the most recent waiter.
+		 */
+		TaskCb *task = LIST_ENTRY(listPop(waitQueue), TaskCb, node);
+		const u8 prio = task->prio;
+		task->res = res;
+
+		// Woken tasks run first but keep their wait queue order among each other.
+		ListNode *const pos = (readyBitmap & BIT(prio) ? lastWoken[prio] : &runQueues[prio]);
+		listAddAfter(pos, &task->node);
+		lastWoken[prio] = &task->node;
+		readyBitmap |= BIT(prio);
+	} while(!listEmpty(waitQueue) && --wakeCount);
+
+	return readyBitmap;
+}
+
 bool waitQueueWakeN(ListNode *waitQueue, u32 wakeCount, KRes res, bool reschedule)
 {
 	if(listEmpty(waitQueue) || !wakeCount)
@@ -170,7 +226,6 @@ bool waitQueueWakeN(ListNode *waitQueue, u32 wakeCount, KRes res, bool reschedul
 	}
 
 	u32 readyBitmap = 0;
-	ListNode *const runQueues = g_runQueues;
 	if(LIKELY(reschedule))
 	{
 		// Put ourself on top of the list first so we run immediately
@@ -178,31 +233,11 @@ bool waitQueueWakeN(ListNode *waitQueue, u32 wakeCount, KRes res, bool reschedul
 		// TODO: Verify if this is a good strategy.
 		TaskCb *const curTask = g_curTask;
 		const u8 curPrio = curTask->prio;
-		listPushTail(&runQueues[curPrio], &curTask->node);
+		listPushTail(&g_runQueues[curPrio], &curTask->node);
 		readyBitmap = BIT(curPrio);
 	}
 
-	do
-	{
-		/*
-		 * Edge case:
-		 * 2 tasks, 1 single shot event. Task 2 waits first and then task 1.
-		 * When signaled (by an IRQ) only task 1 will ever run instead of
-		 * alternating between both because task 1 always lands on the
-		 * head (as intended) but on wakeup we take N tasks from the head
-		 * to preserve order.
-		 *
-		 * Workaround:
-		 * Take tasks from the tail instead. This will however punish
-		 * the longest waiting tasks unnecessarily.
-		 */
-		//TaskCb *task = LIST_ENTRY(listPopHead(waitQueue), TaskCb, node);
-		TaskCb *task = LIST_ENTRY(listPop(waitQueue), TaskCb, node);
-		readyBitmap |= BIT(task->prio);
-		task->res = res;
-		listPushTail(&runQueues[task->prio], &task->node);
-	} while(!listEmpty(waitQueue) && --wakeCount);
-	g_readyBitmap |= readyBitmap;
+	g_readyBitmap |= readyBitmap | wakeTasks(waitQueue, wakeCount, res);
 
 	if(LIKELY(reschedule)) scheduler(TASK_STATE_RUNNING_SHORT);
 	else                   kernelUnlock();
@@ -210,6 +245,23 @@ bool waitQueueWakeN(ListNode *waitQueue, u32 wakeCount, KRes res, bool reschedul
 	return true;
 }
 
+bool waitQueueWakeNLocked(ListNode *waitQueue, u32 wakeCount, KRes res)
+{
+	if(listEmpty(waitQueue) || !wakeCount) return false;
+
+	g_readyBitmap |= wakeTasks(waitQueue, wakeCount, res);
+
+	return true;
+}
+
+void waitQueueWakeTaskLocked(TaskCb *task, KRes res)
+{
+	listDelete(&task->node);
+	task->res = res;
+	listPushTail(&g_runQueues[task->prio], &task->node);
+	g_readyBitmap |= BIT(task->prio);
+}
+
 static KRes scheduler(TaskState curTaskState)
 {
 	TaskCb *const curDeadTask = g_curDeadTask;
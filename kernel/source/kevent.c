@@ -53,6 +53,7 @@ static void eventIrqHandler(u32 intSource)
 KHandle createEvent(bool oneShot)
 {
 	KEvent *const event = (KEvent*)slabAlloc(&g_eventSlab);
+	if(event == NULL) return 0;
 
 	event->signaled = false;
 	*(bool*)&event->oneShot = oneShot;
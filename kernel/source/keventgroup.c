@@ -0,0 +1,179 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include "types.h"
+#include "keventgroup.h"
+#include "internal/list.h"
+#include "arm11/drivers/interrupt.h"
+#include "internal/kernel_private.h"
+#include "internal/util.h"
+#include "internal/slabheap.h"
+#include "internal/config.h"
+
+
+typedef struct
+{
+	u32 flags;
+	ListNode waitQueue;
+} KEventGroup;
+
+typedef struct
+{
+	u32 mask;
+	u32 mode;
+	u32 flags; // Flags at wakeup time.
+} EventGroupWait;
+
+
+static SlabHeap g_eventGroupSlab = {0};
+static struct
+{
+	KHandle kgroup;
+	u32 flags;
+} g_irqEventGroupTable[128 - 32] = {0}; // 128 - 32 private interrupts.
+
+
+
+void _eventGroupSlabInit(void)
+{
+	slabInit(&g_eventGroupSlab, sizeof(KEventGroup), MAX_EVENT_GROUPS);
+}
+
+static void eventGroupIrqHandler(u32 intSource)
+{
+	const u32 idx = intSource - 32;
+	setEventGroupFlags(g_irqEventGroupTable[idx].kgroup, g_irqEventGroupTable[idx].flags, false);
+}
+
+static inline u32 checkWait(u32 flags, u32 mask, u32 mode)
+{
+	const u32 matched = flags & mask;
+	if(mode & EVENT_GROUP_WAIT_ALL) return (matched == mask ? matched : 0);
+	return matched;
+}
+
+KHandle createEventGroup(uint32_t flags)
+{
+	KEventGroup *const group = (KEventGroup*)slabAlloc(&g_eventGroupSlab);
+	if(group == NULL) return 0;
+
+	group->flags = flags;
+	listInit(&group->waitQueue);
+
+	return (KHandle)group;
+}
+
+void deleteEventGroup(KHandle const kgroup)
+{
+	KEventGroup *const group = (KEventGroup*)kgroup;
+
+	kernelLock();
+	waitQueueWakeN(&group->waitQueue, (u32)-1, KRES_HANDLE_DELETED, true);
+
+	slabFree(&g_eventGroupSlab, group);
+}
+
+// TODO: Critical sections needed for bind/unbind?
+void bindInterruptToEventGroup(KHandle const kgroup, uint32_t flags, uint8_t id, uint8_t prio)
+{
+	if(id < 32 || id > 127) return;
+
+	g_irqEventGroupTable[id - 32].kgroup = kgroup;
+	g_irqEventGroupTable[id - 32].flags  = flags;
+	IRQ_registerIsr(id, prio, 0, eventGroupIrqHandler);
+}
+
+void unbindInterruptEventGroup(uint8_t id)
+{
+	if(id < 32 || id > 127) return;
+
+	g_irqEventGroupTable[id - 32].kgroup = 0;
+	IRQ_unregisterIsr(id);
+}
+
+// TODO: Timeout.
+KRes waitForEventGroup(KHandle const kgroup, uint32_t mask, uint32_t mode, uint32_t *const flags)
+{
+	KEventGroup *const group = (KEventGroup*)kgroup;
+	EventGroupWait wait = {mask, mode, 0};
+	KRes res;
+
+	kernelLock();
+	const u32 curFlags = group->flags;
+	const u32 matched = checkWait(curFlags, mask, mode);
+	if(matched != 0)
+	{
+		if(mode & EVENT_GROUP_AUTO_CLEAR) group->flags = curFlags & ~matched;
+		kernelUnlock();
+		wait.flags = curFlags;
+		res = KRES_OK;
+	}
+	else res = waitQueueBlockWithData(&group->waitQueue, &wait);
+
+	if(flags != NULL) *flags = wait.flags;
+
+	return res;
+}
+
+void setEventGroupFlags(KHandle const kgroup, uint32_t flags, bool reschedule)
+{
+	KEventGroup *const group = (KEventGroup*)kgroup;
+	bool woken = false;
+
+	kernelLock();
+	flags |= group->flags;
+
+	// Waiters are checked in queue order. Auto clearing
+	// waiters consume their flags before later ones are checked.
+	ListNode *const waitQueue = &group->waitQueue;
+	ListNode *node = waitQueue->next;
+	while(node != waitQueue)
+	{
+		ListNode *const next = node->next;
+		TaskCb *const task = LIST_ENTRY(node, TaskCb, node);
+		EventGroupWait *const wait = (EventGroupWait*)task->waitData;
+
+		const u32 matched = checkWait(flags, wait->mask, wait->mode);
+		if(matched != 0)
+		{
+			wait->flags = flags;
+			if(wait->mode & EVENT_GROUP_AUTO_CLEAR) flags &= ~matched;
+			waitQueueWakeTaskLocked(task, KRES_OK);
+			woken = true;
+		}
+
+		node = next;
+	}
+	group->flags = flags;
+	kernelUnlock();
+
+	if(woken && reschedule) yieldTask();
+}
+
+void clearEventGroupFlags(KHandle const kgroup, uint32_t flags)
+{
+	kernelLock();
+	((KEventGroup*)kgroup)->flags &= ~flags;
+	kernelUnlock();
+}
+
+uint32_t getEventGroupFlags(KHandle const kgroup)
+{
+	return ((const KEventGroup*)kgroup)->flags;
+}
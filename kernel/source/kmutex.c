@@ -45,6 +45,7 @@ void _mutexSlabInit(void)
 KHandle createMutex(void)
 {
 	KMutex *const kmutex = (KMutex*)slabAlloc(&g_mutexSlab);
+	if(kmutex == NULL) return 0;
 
 	kmutex->owner = NULL;
 	listInit(&kmutex->waitQueue);
@@ -72,7 +73,7 @@ KRes lockMutex(KHandle const kmutex)
 		kernelLock();
 		if(UNLIKELY(mutex->owner != NULL))
 		{
-			res = waitQueueBlock(&mutex->waitQueue);
+			res = waitQueueBlockPrio(&mutex->waitQueue);
 			if(UNLIKELY(res != KRES_OK)) break;
 		}
 		else
@@ -107,3 +108,17 @@ KRes unlockMutex(KHandle const kmutex)
 
 	return res;
 }
+
+// Internal. Used by condition variables.
+// Expects the kernel lock to be held and doesn't release it.
+KRes _mutexReleaseLocked(KHandle const kmutex)
+{
+	KMutex *const mutex = (KMutex*)kmutex;
+
+	if(UNLIKELY(mutex->owner != getCurrentTask())) return KRES_NO_PERMISSIONS;
+
+	mutex->owner = NULL;
+	waitQueueWakeNLocked(&mutex->waitQueue, 1, KRES_OK);
+
+	return KRES_OK;
+}
@@ -0,0 +1,180 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include "types.h"
+#include "krwlock.h"
+#include "internal/list.h"
+#include "internal/kernel_private.h"
+#include "internal/util.h"
+#include "internal/slabheap.h"
+#include "internal/config.h"
+
+
+typedef struct
+{
+	s32 readers;          // Number of readers holding the lock. -1 if write locked.
+	const TaskCb *writer;
+	u16 waitingReaders;
+	u16 waitingWriters;
+	ListNode readQueue;
+	ListNode writeQueue;
+} KRwLock;
+
+
+static SlabHeap g_rwLockSlab = {0};
+
+
+
+void _rwLockSlabInit(void)
+{
+	slabInit(&g_rwLockSlab, sizeof(KRwLock), MAX_RWLOCKS);
+}
+
+KHandle createRwLock(void)
+{
+	KRwLock *const rwLock = (KRwLock*)slabAlloc(&g_rwLockSlab);
+	if(rwLock == NULL) return 0;
+
+	rwLock->readers        = 0;
+	rwLock->writer         = NULL;
+	rwLock->waitingReaders = 0;
+	rwLock->waitingWriters = 0;
+	listInit(&rwLock->readQueue);
+	listInit(&rwLock->writeQueue);
+
+	return (KHandle)rwLock;
+}
+
+void deleteRwLock(KHandle const krwlock)
+{
+	KRwLock *const rwLock = (KRwLock*)krwlock;
+
+	kernelLock();
+	waitQueueWakeNLocked(&rwLock->readQueue, (u32)-1, KRES_HANDLE_DELETED);
+	waitQueueWakeN(&rwLock->writeQueue, (u32)-1, KRES_HANDLE_DELETED, true);
+
+	slabFree(&g_rwLockSlab, rwLock);
+}
+
+// Ownership is handed over directly to the woken tasks.
+// They return from waitQueueBlock() with the lock already held.
+static void handOverToWriter(KRwLock *const rwLock)
+{
+	rwLock->readers = -1;
+	rwLock->writer  = LIST_FIRST_ENTRY(&rwLock->writeQueue, TaskCb, node);
+	rwLock->waitingWriters--;
+	waitQueueWakeN(&rwLock->writeQueue, 1, KRES_OK, true);
+}
+
+static void handOverToReaders(KRwLock *const rwLock)
+{
+	rwLock->readers        = rwLock->waitingReaders;
+	rwLock->writer         = NULL;
+	rwLock->waitingReaders = 0;
+	waitQueueWakeN(&rwLock->readQueue, (u32)-1, KRES_OK, true);
+}
+
+KRes lockRwLockRead(KHandle const krwlock)
+{
+	KRwLock *const rwLock = (KRwLock*)krwlock;
+	KRes res;
+
+	kernelLock();
+	if(LIKELY(rwLock->readers >= 0 && rwLock->waitingWriters == 0))
+	{
+		rwLock->readers++;
+		kernelUnlock();
+		res = KRES_OK;
+	}
+	else
+	{
+		rwLock->waitingReaders++;
+		res = waitQueueBlockPrio(&rwLock->readQueue);
+	}
+
+	return res;
+}
+
+KRes unlockRwLockRead(KHandle const krwlock)
+{
+	KRwLock *const rwLock = (KRwLock*)krwlock;
+	KRes res = KRES_OK;
+
+	kernelLock();
+	if(LIKELY(rwLock->readers > 0))
+	{
+		if(--rwLock->readers == 0 && rwLock->waitingWriters != 0) handOverToWriter(rwLock);
+		else kernelUnlock();
+	}
+	else
+	{
+		kernelUnlock();
+		res = KRES_NO_PERMISSIONS;
+	}
+
+	return res;
+}
+
+KRes lockRwLockWrite(KHandle const krwlock)
+{
+	KRwLock *const rwLock = (KRwLock*)krwlock;
+	KRes res;
+
+	kernelLock();
+	if(LIKELY(rwLock->readers == 0))
+	{
+		rwLock->readers = -1;
+		rwLock->writer  = getCurrentTask();
+		kernelUnlock();
+		res = KRES_OK;
+	}
+	else
+	{
+		rwLock->waitingWriters++;
+		res = waitQueueBlockPrio(&rwLock->writeQueue);
+	}
+
+	return res;
+}
+
+KRes unlockRwLockWrite(KHandle const krwlock)
+{
+	KRwLock *const rwLock = (KRwLock*)krwlock;
+	KRes res = KRES_OK;
+
+	kernelLock();
+	if(LIKELY(rwLock->readers < 0 && rwLock->writer == getCurrentTask()))
+	{
+		if(rwLock->waitingReaders != 0)      handOverToReaders(rwLock);
+		else if(rwLock->waitingWriters != 0) handOverToWriter(rwLock);
+		else
+		{
+			rwLock->readers = 0;
+			rwLock->writer  = NULL;
+			kernelUnlock();
+		}
+	}
+	else
+	{
+		kernelUnlock();
+		res = KRES_NO_PERMISSIONS;
+	}
+
+	return res;
+}
@@ -45,6 +45,7 @@ void _semaphoreSlabInit(void)
 KHandle createSemaphore(int32_t count)
 {
 	KSema *const ksema = (KSema*)slabAlloc(&g_semaSlab);
+	if(ksema == NULL) return 0;
 
 	ksema->count = count;
 	listInit(&ksema->waitQueue);
@@ -82,7 +83,7 @@ KRes waitForSemaphore(KHandle const ksema)
 	KRes res;
 
 	kernelLock();
-	if(UNLIKELY(--sema->count < 0)) res = waitQueueBlock(&sema->waitQueue);
+	if(UNLIKELY(--sema->count < 0)) res = waitQueueBlockPrio(&sema->waitQueue);
 	else {kernelUnlock(); res = KRES_OK;}
 
 	return res;
@@ -0,0 +1,118 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include "types.h"
+#include "kworkqueue.h"
+#include "kevent.h"
+#include "internal/kernel_private.h"
+#include "internal/util.h"
+#include "internal/slabheap.h"
+#include "internal/config.h"
+
+
+typedef struct
+{
+	_Atomic(KWork*) head; // LIFO of items queued since the last wakeup.
+	KHandle event;
+} KWorkQueue;
+
+
+static SlabHeap g_workQueueSlab = {0};
+
+
+
+void _workQueueSlabInit(void)
+{
+	slabInit(&g_workQueueSlab, sizeof(KWorkQueue), MAX_WORK_QUEUES);
+}
+
+[[noreturn]] static void workerTask(void *arg)
+{
+	KWorkQueue *const wq = (KWorkQueue*)arg;
+
+	do
+	{
+		(void)waitForEvent(wq->event);
+
+		// Take the whole batch at once. Anything queued after this
+		// will signal the event again and ends up in the next batch.
+		KWork *work = atomic_exchange_explicit(&wq->head, NULL, memory_order_acquire);
+
+		// The list is in LIFO order. Reverse it so items run in queue order.
+		KWork *batch = NULL;
+		while(work != NULL)
+		{
+			KWork *const next = work->next;
+			work->next = batch;
+			batch = work;
+			work = next;
+		}
+
+		while(batch != NULL)
+		{
+			work = batch;
+			batch = work->next;
+
+			// Release the item before running it so the work function can requeue it.
+			const WorkFunc func = work->func;
+			void *const funcArg = work->arg;
+			atomic_store_explicit(&work->pending, false, memory_order_release);
+
+			func(funcArg);
+		}
+	} while(1);
+}
+
+KHandle createWorkQueue(size_t stackSize, uint8_t priority)
+{
+	KWorkQueue *const wq = (KWorkQueue*)slabAlloc(&g_workQueueSlab);
+	if(wq == NULL) return 0;
+
+	atomic_init(&wq->head, NULL);
+	const KHandle event = createEvent(true);
+	wq->event = event;
+	if(event == 0 || createTask(stackSize, priority, (TaskFunc)workerTask, wq) == 0)
+	{
+		if(event != 0) deleteEvent(event);
+		slabFree(&g_workQueueSlab, wq);
+		return 0;
+	}
+
+	return (KHandle)wq;
+}
+
+bool queueWork(KHandle const kwq, KWork *const work)
+{
+	KWorkQueue *const wq = (KWorkQueue*)kwq;
+
+	// Claim the item. Fails if it's still waiting in a queue.
+	if(atomic_exchange_explicit(&work->pending, true, memory_order_acquire)) return false;
+
+	KWork *head = atomic_load_explicit(&wq->head, memory_order_relaxed);
+	do
+	{
+		work->next = head;
+	} while(!atomic_compare_exchange_weak_explicit(&wq->head, &head, work,
+	                                               memory_order_release, memory_order_relaxed));
+
+	// Only the first item of a batch needs to wake the worker.
+	if(head == NULL) signalEvent(wq->event, false);
+
+	return true;
+}
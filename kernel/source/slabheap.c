@@ -23,26 +23,47 @@
 
 
 
-void slabInit(SlabHeap *slab, size_t objSize, size_t num)
+void slabInit(SlabHeap *slab, size_t objSize, size_t maxNum)
 {
-	if(objSize < sizeof(SlabHeap) || !num) return;
+	listInit(&slab->freeList);
+	// Keep all slots word aligned.
+	slab->objSize = (objSize < sizeof(ListNode) ? sizeof(ListNode) : (objSize + 3u) & ~3u);
+	slab->num     = 0;
+	slab->maxNum  = maxNum;
+}
 
-	listInit(slab);
+static bool slabGrow(SlabHeap *slab)
+{
+	const size_t objSize = slab->objSize;
+	size_t num = SLAB_CHUNK_SIZE / objSize;
+	if(num == 0) num = 1;
+
+	const size_t maxNum = slab->maxNum;
+	if(maxNum != 0)
+	{
+		const size_t left = maxNum - slab->num;
+		if(left == 0) return false;
+		if(num > left) num = left;
+	}
 
 	u8 *pool = malloc(objSize * num);
-	if(!pool) return;
+	if(!pool) return false;
+	slab->num += num;
 	do
 	{
-		listPush(slab, (SlabHeap*)pool);
+		listPush(&slab->freeList, (ListNode*)pool);
 		pool += objSize;
 	} while(--num);
+
+	return true;
 }
 
 void* slabAlloc(SlabHeap *slab)
 {
-	if(!slab || listEmpty(slab)) return NULL;
+	if(!slab) return NULL;
+	if(listEmpty(&slab->freeList) && !slabGrow(slab)) return NULL;
 
-	return listPop(slab);
+	return listPop(&slab->freeList);
 }
 
 void* slabCalloc(SlabHeap *slab, size_t clrSize)
@@ -58,5 +79,5 @@ void slabFree(SlabHeap *slab, void *ptr)
 
 	// Keep gaps filled by allocating the same mem
 	// again next time an object is allocated.
-	listPushTail(slab, (SlabHeap*)ptr);
+	listPushTail(&slab->freeList, (ListNode*)ptr);
 }
@@ -327,6 +327,7 @@ void GFX_init(const GfxFmt fmtTop, const GfxFmt fmtBot, const GfxTopMode mode)
 	for(unsigned i = 0; i < 6; i++)
 	{
 		KHandle kevent = createEvent(false);
+		if(kevent == 0) panic();
 		bindInterruptToEvent(kevent, IRQ_PSC0 + i, 14);
 		state->events[i] = kevent;
 	}
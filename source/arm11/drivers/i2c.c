@@ -21,6 +21,7 @@
 #include "kevent.h"
 #include "kmutex.h"
 #include "arm11/drivers/interrupt.h"
+#include "debug.h"
 
 
 static const struct
@@ -97,10 +98,13 @@ void I2C_init(void)
 	{
 		static const Interrupt i2cIrqs[3] = {IRQ_I2C1, IRQ_I2C2, IRQ_I2C3};
 		const KHandle event = createEvent(true);
+		if(event == 0) panic();
 		bindInterruptToEvent(event, i2cIrqs[i], 14);
 		g_i2cState[i].event = event;
 
-		g_i2cState[i].mutex = createMutex();
+		const KHandle mutex = createMutex();
+		if(mutex == 0) panic();
+		g_i2cState[i].mutex = mutex;
 
 		I2cBus *const i2cBus = g_i2cState[i].i2cBus;
 		while(i2cBus->cnt & I2C_EN);
@@ -161,10 +161,15 @@ static inline u32 getPixelSize(const u32 lgycap_cnt)
 KHandle LGYCAP_init(const LgyCapDev dev, const LgyCapCfg *const cfg)
 {
 	if(!patchDmaProg(cfg->w, getPixelSize(cfg->cnt))) return 0;
-	if(DMA330_run(dev, g_lgyCapDmaProg)) return 0;
 
 	// Create KEvent for frame ready signal.
 	KHandle frameReadyEvent = createEvent(false);
+	if(frameReadyEvent == 0) return 0;
+	if(DMA330_run(dev, g_lgyCapDmaProg))
+	{
+		deleteEvent(frameReadyEvent);
+		return 0;
+	}
 	g_frameReadyEvents[dev] = frameReadyEvent;
 
 	LgyCap *const lgyCap = getLgyCapRegs(dev);
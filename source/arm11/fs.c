@@ -47,6 +47,12 @@ Result fGetFree(FsDrive drive, u64 *const size)
 	return PXI_sendCmd(IPC_CMD9_FGETFREE, cmdBuf, 3);
 }
 
+Result fDiscardFree(FsDrive drive)
+{
+	const u32 cmdBuf = drive;
+	return PXI_sendCmd(IPC_CMD9_FDISCARD_FREE, &cmdBuf, 1);
+}
+
 Result fOpen(FHandle *const hOut, const char *const path, u8 mode)
 {
 	u32 cmdBuf[5];
@@ -89,25 +95,62 @@ Result fSync(FHandle h)
 	return PXI_sendCmd(IPC_CMD9_FSYNC, &cmdBuf, 1);
 }
 
-Result fLseek(FHandle h, u32 off)
+Result fAllocate(FHandle h, u64 size, u8 flags)
 {
-	u32 cmdBuf[2];
+	u32 cmdBuf[4];
 	cmdBuf[0] = h;
-	cmdBuf[1] = off;
+	cmdBuf[1] = (u32)size;
+	cmdBuf[2] = (u32)(size>>32);
+	cmdBuf[3] = flags;
 
-	return PXI_sendCmd(IPC_CMD9_FLSEEK, cmdBuf, 2);
+	return PXI_sendCmd(IPC_CMD9_FALLOCATE, cmdBuf, 4);
 }
 
-u32 fTell(FHandle h)
+Result fLseek(FHandle h, u64 off)
 {
-	const u32 cmdBuf = h;
-	return PXI_sendCmd(IPC_CMD9_FTELL, &cmdBuf, 1);
+	u32 cmdBuf[3];
+	cmdBuf[0] = h;
+	cmdBuf[1] = (u32)off;
+	cmdBuf[2] = (u32)(off>>32);
+
+	return PXI_sendCmd(IPC_CMD9_FLSEEK, cmdBuf, 3);
 }
 
-u32 fSize(FHandle h)
+// The result word is only 32 bit. 64 bit values are returned in a buffer.
+u64 fTell(FHandle h)
 {
-	const u32 cmdBuf = h;
-	return PXI_sendCmd(IPC_CMD9_FSIZE, &cmdBuf, 1);
+	u64 pos = 0;
+	u32 cmdBuf[3];
+	cmdBuf[0] = (u32)&pos;
+	cmdBuf[1] = sizeof(u64);
+	cmdBuf[2] = h;
+
+	PXI_sendCmd(IPC_CMD9_FTELL, cmdBuf, 3);
+
+	return pos;
+}
+
+u64 fSize(FHandle h)
+{
+	u64 size = 0;
+	u32 cmdBuf[3];
+	cmdBuf[0] = (u32)&size;
+	cmdBuf[1] = sizeof(u64);
+	cmdBuf[2] = h;
+
+	PXI_sendCmd(IPC_CMD9_FSIZE, cmdBuf, 3);
+
+	return size;
+}
+
+Result fGetStats(FHandle h, FsFileStats *const stats)
+{
+	u32 cmdBuf[3];
+	cmdBuf[0] = (u32)stats;
+	cmdBuf[1] = sizeof(FsFileStats);
+	cmdBuf[2] = h;
+
+	return PXI_sendCmd(IPC_CMD9_FGET_STATS, cmdBuf, 3);
 }
 
 Result fClose(FHandle h)
@@ -127,6 +170,15 @@ Result fStat(const char *const path, FILINFO *const fi)
 	return PXI_sendCmd(IPC_CMD9_FSTAT, cmdBuf, 4);
 }
 
+Result fGetPathCacheStats(FsPathCacheStats *const stats)
+{
+	u32 cmdBuf[2];
+	cmdBuf[0] = (u32)stats;
+	cmdBuf[1] = sizeof(FsPathCacheStats);
+
+	return PXI_sendCmd(IPC_CMD9_FPATH_STATS, cmdBuf, 2);
+}
+
 Result fChdir(const char *const path)
 {
 	u32 cmdBuf[2];
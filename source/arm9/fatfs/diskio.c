@@ -7,89 +7,452 @@
 /* storage control modules to the FatFs module with a defined API.       */
 /*-----------------------------------------------------------------------*/
 
+#include <string.h>
 #include "fatfs/source/ff.h"			/* Obtains integer types */
 #include "fatfs/source/diskio.h"		/* Declarations of disk functions */
 #include "types.h"
 #include "drivers/tmio.h"
+#include "drivers/tmio_config.h"
 #include "drivers/mmc/sdmmc.h"
 #include "arm9/drivers/ndma.h"
 #include "drivers/cache.h"
 #include "arm9/drivers/timer.h"
+#include "arm9/diskio.h"
 
 
+// Sectors per half of the double buffered bounce buffer used for unaligned buffers.
+// 0 disables the bounce buffer and unaligned buffers use slow CPU transfers.
+#ifndef DISKIO_BOUNCE_SECTORS
+#define DISKIO_BOUNCE_SECTORS  (8u)
+#endif
 
-/*-----------------------------------------------------------------------*/
-/* Get Drive Status                                                      */
-/*-----------------------------------------------------------------------*/
+// Sector cache size in sectors and associativity. 0 sectors disables the cache.
+// The number of sets (sectors / ways) must be a power of 2.
+#ifndef DISKIO_CACHE_SECTORS
+#define DISKIO_CACHE_SECTORS   (64u)
+#endif
+#ifndef DISKIO_CACHE_WAYS
+#define DISKIO_CACHE_WAYS      (4u)
+#endif
 
-DSTATUS disk_status (
-	BYTE pdrv		/* Physical drive nmuber to identify the drive */
-)
+// Maximum sequential read-ahead window in sectors. 0 disables read-ahead.
+// The window can be lowered at runtime with DISKIO_setReadAhead().
+#ifndef DISKIO_READAHEAD_SECTORS
+#define DISKIO_READAHEAD_SECTORS  (64u)
+#endif
+
+// Write coalescing buffer size in sectors. Must be a power of 2. 0 disables write coalescing.
+#ifndef DISKIO_COALESCE_SECTORS
+#define DISKIO_COALESCE_SECTORS   (64u)
+#endif
+#if FF_FS_READONLY != 0
+#undef DISKIO_COALESCE_SECTORS
+#define DISKIO_COALESCE_SECTORS   (0u)
+#endif
+
+// Queued CTRL_TRIM ranges. Erasing can keep a SD card busy for seconds so CTRL_TRIM
+// only queues the range and DISKIO_pollIdle() erases it in chunks. 0 erases immediately.
+#ifndef DISKIO_TRIM_QUEUE
+#define DISKIO_TRIM_QUEUE  (8u)
+#endif
+#if FF_FS_READONLY != 0
+#undef DISKIO_TRIM_QUEUE
+#define DISKIO_TRIM_QUEUE  (0u)
+#endif
+
+// Inactivity timeout in milliseconds after which devices are put to sleep.
+// 0 disables the idle policy. Otherwise reserves timer 2 (see tmio_config.h).
+#ifndef DISKIO_IDLE_TIMEOUT_MS
+#define DISKIO_IDLE_TIMEOUT_MS  (0u)
+#endif
+
+// FAT sectors read per chunk by DISKIO_discardFree().
+#define DISCARD_FAT_SECTORS  (4u)
+
+// Sectors erased from the TRIM queue per DISKIO_pollIdle() call.
+#define TRIM_CHUNK_SECTORS   (2048u) // 1 MiB.
+
+// The physical drive number is the volume index. Bit 7 is used as flag by disk_read().
+#define PDRV_MASK  (0x7Fu)
+
+// Block device per FatFs physical drive.
+typedef struct
 {
-	(void)pdrv;
+	u8 devNum;        // SDMMC_DEV_...
+	u8 controller;    // TMIO controller the device is connected to.
+	u8 ndmaCh;        // NDMA channel for FIFO transfers. Must be unique per volume.
+	u32 ndmaStart;    // NDMA start condition (FIFO of the controller).
+} DiskVol;
+
+static const DiskVol g_vols[FF_VOLUMES] =
+{
+	{SDMMC_DEV_CARD, TMIO_CARD_PORT / 2, 5, (TMIO_CARD_PORT == 2 ? NDMA_START_TMIO3 : NDMA_START_TMIO1)},
+	{SDMMC_DEV_eMMC, TMIO_eMMC_PORT / 2, 4, NDMA_START_TMIO1}
+};
+static_assert(FF_VOLUMES == 2, "Volume table doesn't match FF_VOLUMES.");
+
+#if DISKIO_BOUNCE_SECTORS > 0
+// Cache line aligned so cache maintenance doesn't touch other data.
+alignas(32) static u8 g_bounceBuf[2][DISKIO_BOUNCE_SECTORS * 512];
+#endif
+
+#if DISKIO_CACHE_SECTORS > 0
+#define CACHE_SETS        (DISKIO_CACHE_SECTORS / DISKIO_CACHE_WAYS)
+static_assert(CACHE_SETS > 0 && (CACHE_SETS & (CACHE_SETS - 1)) == 0, "Sector cache sets must be a power of 2.");
+
+// CacheLine.state
+#define CACHE_VALID       BIT(0)
+#define CACHE_DIRTY       BIT(1)
+
+// CacheLine.prio. Higher priority sectors are pinned against lower priority ones.
+enum
+{
+	CACHE_PRIO_DATA = 0u, // File data.
+	CACHE_PRIO_DIR  = 1u, // Directory sectors and other FatFs window reads.
+	CACHE_PRIO_FAT  = 2u  // FAT sectors.
+};
+
+typedef struct
+{
+	LBA_t sector;
+	u32 lastUse;  // LRU timestamp.
+	u8 state;
+	u8 prio;
+	u8 vol;       // Volume the sector belongs to.
+} CacheLine;
+
+static struct
+{
+	CacheLine lines[DISKIO_CACHE_SECTORS]; // DISKIO_CACHE_WAYS consecutive lines per set.
+	u32 tick;
+	LBA_t fatStart[FF_VOLUMES];
+	LBA_t fatEnd[FF_VOLUMES];
+} g_cache = {0};
+alignas(32) static u8 g_cacheData[DISKIO_CACHE_SECTORS][512];
+#endif // #if DISKIO_CACHE_SECTORS > 0
+
+#if DISKIO_READAHEAD_SECTORS > 0
+static struct
+{
+	SdmmcReq req;
+	LBA_t nextSector; // Sector following the last data read.
+	LBA_t start;      // First sector in the read-ahead buffer.
+	u32 count;        // Sectors in (or on their way to) the buffer. 0 = empty.
+	u32 window;       // Read-ahead size in sectors. 0 = disabled.
+	u8 vol;           // Volume of the read-ahead stream.
+	bool inFlight;
+	bool sequential;  // The last data read continued the previous one.
+} g_ra = {.req = {.op = SDMMC_REQ_READ}, .window = DISKIO_READAHEAD_SECTORS};
+alignas(32) static u8 g_raBuf[DISKIO_READAHEAD_SECTORS * 512];
+#endif // #if DISKIO_READAHEAD_SECTORS > 0
+
+#if DISKIO_COALESCE_SECTORS > 0
+static_assert((DISKIO_COALESCE_SECTORS & (DISKIO_COALESCE_SECTORS - 1)) == 0, "Write coalescing size must be a power of 2.");
+
+static struct
+{
+	LBA_t start; // First sector in the coalescing buffer.
+	u32 count;   // Buffered sectors. 0 = empty.
+	u8 vol;      // Volume of the buffered sectors.
+} g_wc = {0};
+alignas(32) static u8 g_wcBuf[DISKIO_COALESCE_SECTORS * 512];
+#endif // #if DISKIO_COALESCE_SECTORS > 0
+
+#if DISKIO_TRIM_QUEUE > 0
+typedef struct
+{
+	LBA_t sector;
+	LBA_t count;
+	u8 vol;
+} TrimRange;
+
+static struct
+{
+	TrimRange ranges[DISKIO_TRIM_QUEUE];
+	u32 num;
+} g_trim = {0};
+#endif // #if DISKIO_TRIM_QUEUE > 0
+
+static DiskioStats g_stats = {0};
+
+// SD card state exported after init. Used to reattach a
+// card which stayed inserted without a full init.
+static struct
+{
+	bool valid;
+	u8 state[64];
+} g_devCache = {0};
+
 
-	return SDMMC_getDiskStatus(SDMMC_DEV_CARD);
+
+// The allocation unit as power of 2 in sectors as required by GET_BLOCK_SIZE. 0 = unknown.
+static u32 getAuSize(const u8 vol)
+{
+	SdmmcInfo info;
+	SDMMC_getDevInfo(g_vols[vol].devNum, &info);
+
+	// Non-power of 2 AUs (SDXC) are multiples of their lowest set bit.
+	u32 auSize = info.auSize & -info.auSize;
+	if(auSize > 32768) auSize = 32768;
+
+	return auSize;
 }
 
+static NdmaCh* startTmioDma(const u8 vol, const void *const buf, const bool toCard)
+{
+	const DiskVol *const dv = &g_vols[vol];
+	NdmaCh *const ndmaCh = getNdmaChRegs(dv->ndmaCh);
+	vu32 *const fifo = getTmioFifo(getTmioRegs(dv->controller));
+	if(toCard)
+	{
+		ndmaCh->sad = (u32)buf;
+		ndmaCh->dad = (u32)fifo;
+	}
+	else
+	{
+		ndmaCh->sad = (u32)fifo;
+		ndmaCh->dad = (u32)buf;
+	}
+	ndmaCh->wcnt = 512 / 4;
+	ndmaCh->bcnt = NDMA_FASTEST;
+	ndmaCh->cnt  = NDMA_EN | dv->ndmaStart | NDMA_REPEAT_MODE | NDMA_BURST(64 / 4) |
+	               (toCard ? NDMA_SAD_INC | NDMA_DAD_FIX : NDMA_SAD_FIX | NDMA_DAD_INC);
 
+	return ndmaCh;
+}
 
-/*-----------------------------------------------------------------------*/
-/* Inidialize a Drive                                                    */
-/*-----------------------------------------------------------------------*/
+// Starts an async DMA transfer from/to an aligned buffer.
+static u32 startDmaRequest(const u8 vol, SdmmcReq *const req, const u8 *const buf, const u32 sector, const u32 count)
+{
+	// Warning! Flush before transfer only works on ARM9 (no speculative prefetching)!
+	flushDCacheRange(buf, 512 * count);
+	const bool toCard = req->op == SDMMC_REQ_WRITE;
+	NdmaCh *const ndmaCh = startTmioDma(vol, buf, toCard);
 
-DSTATUS disk_initialize (
-	BYTE pdrv				/* Physical drive number to identify the drive */
-)
+	req->sect  = sector;
+	req->buf   = NULL; // DMA.
+	req->count = count;
+	const u32 res = SDMMC_submitRequest(g_vols[vol].devNum, req);
+	if(res != SDMMC_ERR_NONE) ndmaCh->cnt = 0;
+
+	return res;
+}
+
+// Waits for an async DMA transfer. buf is the buffer passed to startDmaRequest().
+static u32 finishDmaRequest(const u8 vol, SdmmcReq *const req, const u8 *const buf)
 {
-	(void)pdrv;
+	const u32 res = SDMMC_waitRequest(req);
 
-	// Workaround for card detect time.
-	unsigned timeout = 5;
-	while(!TMIO_cardDetected() && timeout > 0)
+	// Stop DMA.
+	getNdmaChRegs(g_vols[vol].ndmaCh)->cnt = 0;
+
+	// NDMA hardware bug workaround.
+	if(req->op == SDMMC_REQ_WRITE) (void)*((const vu8*)buf);
+
+	return res;
+}
+
+#if DISKIO_BOUNCE_SECTORS > 0
+// Unaligned reads go through the bounce buffer. The next chunk is
+// read into one half while the previous one is copied out of the other.
+// Note: copy32() needs an aligned destination so memcpy() is used to copy out.
+static DRESULT readBounced(const u8 vol, BYTE *buff, LBA_t sector, UINT count)
+{
+	SdmmcReq req = {.op = SDMMC_REQ_READ};
+	u32 cur = 0;
+	u32 curCount = (count > DISKIO_BOUNCE_SECTORS ? DISKIO_BOUNCE_SECTORS : count);
+	u32 res = startDmaRequest(vol, &req, g_bounceBuf[cur], sector, curCount);
+	while(res == SDMMC_ERR_NONE)
 	{
-		TIMER_sleepMs(2);
-		timeout--;
+		res = finishDmaRequest(vol, &req, g_bounceBuf[cur]);
+		if(res != SDMMC_ERR_NONE) break;
+
+		sector += curCount;
+		count -= curCount;
+
+		// Start the next chunk before copying out this one.
+		const u32 nextCount = (count > DISKIO_BOUNCE_SECTORS ? DISKIO_BOUNCE_SECTORS : count);
+		if(nextCount > 0) res = startDmaRequest(vol, &req, g_bounceBuf[cur ^ 1], sector, nextCount);
+
+		memcpy(buff, g_bounceBuf[cur], 512 * curCount);
+		buff += 512 * curCount;
+		cur ^= 1;
+		curCount = nextCount;
+
+		if(curCount == 0) break;
 	}
 
-	if(timeout == 0)
-		return STA_NODISK | STA_NOINIT;
+	return (res == SDMMC_ERR_NONE ? RES_OK : RES_ERROR);
+}
+
+#if FF_FS_READONLY == 0
+// Unaligned writes go through the bounce buffer. The next chunk is
+// copied into one half while the previous one is written from the other.
+static DRESULT writeBounced(const u8 vol, const BYTE *buff, LBA_t sector, UINT count)
+{
+	SdmmcReq req = {.op = SDMMC_REQ_WRITE};
+	bool inFlight = false;
+	u32 cur = 0;
+	u32 res = SDMMC_ERR_NONE;
+	while(count > 0)
+	{
+		const u32 chunk = (count > DISKIO_BOUNCE_SECTORS ? DISKIO_BOUNCE_SECTORS : count);
+		memcpy(g_bounceBuf[cur], buff, 512 * chunk);
+
+		if(inFlight)
+		{
+			inFlight = false;
+			res = finishDmaRequest(vol, &req, g_bounceBuf[cur ^ 1]);
+			if(res != SDMMC_ERR_NONE) break;
+		}
+
+		res = startDmaRequest(vol, &req, g_bounceBuf[cur], sector, chunk);
+		if(res != SDMMC_ERR_NONE) break;
+		inFlight = true;
 
-	return (SDMMC_init(SDMMC_DEV_CARD) == SDMMC_ERR_NONE ? 0 : STA_NOINIT);
+		buff += 512 * chunk;
+		sector += chunk;
+		count -= chunk;
+		cur ^= 1;
+	}
+
+	if(inFlight) res = finishDmaRequest(vol, &req, g_bounceBuf[cur ^ 1]);
+
+	return (res == SDMMC_ERR_NONE ? RES_OK : RES_ERROR);
 }
+#endif // #if FF_FS_READONLY == 0
+#endif // #if DISKIO_BOUNCE_SECTORS > 0
 
 
 
-/*-----------------------------------------------------------------------*/
-/* Read Sector(s)                                                        */
-/*-----------------------------------------------------------------------*/
+#if DISKIO_READAHEAD_SECTORS > 0
+// Transfers must wait for read-ahead on the same controller (TMIO_CARD_PORT 0).
+// NDMA channels of other volumes would react to its FIFO requests.
+static inline bool raSharesController(const u8 vol)
+{
+	return g_vols[vol].controller == g_vols[g_ra.vol].controller;
+}
 
-DRESULT disk_read (
-	BYTE pdrv,		/* Physical drive nmuber to identify the drive */
-	BYTE *buff,		/* Data buffer to store read data */
-	LBA_t sector,	/* Start sector in LBA */
-	UINT count		/* Number of sectors to read */
-)
+// Waits for the read-ahead transfer. The NDMA channel is free afterwards.
+static DRESULT raFinish(void)
 {
-	(void)pdrv;
+	if(!g_ra.inFlight) return RES_OK;
 
+	g_ra.inFlight = false;
+	if(finishDmaRequest(g_ra.vol, &g_ra.req, g_raBuf) != SDMMC_ERR_NONE)
+	{
+		g_ra.count = 0;
+		return RES_ERROR;
+	}
+
+	return RES_OK;
+}
+
+// In flight transfers can't be aborted. Let it finish and drop the data.
+static void raCancel(void)
+{
+	raFinish();
+	g_ra.count = 0;
+}
+
+static void raStart(const u8 vol, const LBA_t sector)
+{
+	const u32 sectors = SDMMC_getSectors(g_vols[vol].devNum);
+	if(sector >= sectors) return;
+	u32 count = g_ra.window;
+	if(count > sectors - sector) count = sectors - sector;
+	if(count == 0) return;
+
+	if(startDmaRequest(vol, &g_ra.req, g_raBuf, sector, count) == SDMMC_ERR_NONE)
+	{
+		g_ra.vol      = vol;
+		g_ra.start    = sector;
+		g_ra.count    = count;
+		g_ra.inFlight = true;
+		g_stats.readAheadSectors += count;
+	}
+}
+
+// Serves sequential data reads from the read-ahead buffer.
+// Returns true if the read was served.
+static bool raRead(const u8 vol, BYTE *const buff, const LBA_t sector, const UINT count)
+{
+	// Only one volume has a read-ahead stream at a time.
+	// Leave the stream of the other volume alone while it has data.
+	if(vol != g_ra.vol)
+	{
+		g_ra.sequential = false;
+		if(g_ra.count > 0) return false;
+
+		g_ra.vol        = vol;
+		g_ra.nextSector = sector + count;
+		return false;
+	}
+
+	// A seek ends the sequential stream.
+	const bool sequential = (sector == g_ra.nextSector);
+	g_ra.nextSector = sector + count;
+	g_ra.sequential = sequential;
+	if(g_ra.count == 0) return false;
+
+	const LBA_t start = g_ra.start;
+	if(sequential && sector >= start && sector + count <= start + g_ra.count)
+	{
+		if(raFinish() == RES_OK)
+		{
+			memcpy(buff, &g_raBuf[(sector - start) * 512], 512 * count);
+			g_stats.readAheadHits++;
+
+			// Refill once the buffer has been consumed.
+			if(sector + count == start + g_ra.count) raStart(vol, sector + count);
+
+			return true;
+		}
+	}
+
+	g_stats.readAheadMisses++;
+	raCancel();
+
+	return false;
+}
+
+// Keeps the read-ahead buffer coherent with writes to the card.
+static void raInvalidateRange(const u8 vol, const LBA_t sector, const UINT count)
+{
+	if(g_ra.count > 0 && vol == g_ra.vol && sector < g_ra.start + g_ra.count && g_ra.start < sector + count)
+		raCancel();
+}
+#endif // #if DISKIO_READAHEAD_SECTORS > 0
+
+
+
+// The driver uses 32 bit sector numbers. Rejects anything past the end of the device.
+static bool isValidRange(const u8 vol, const LBA_t sector, const LBA_t count)
+{
+	const LBA_t sectors = SDMMC_getSectors(g_vols[vol].devNum);
+	return sector < sectors && count <= sectors - sector;
+}
+
+static DRESULT readSectors(const u8 vol, BYTE *buff, LBA_t sector, UINT count)
+{
 	DRESULT res = RES_OK;
+#if DISKIO_READAHEAD_SECTORS > 0
+	// The read-ahead transfer uses the same DMA channel.
+	// Transfers on the other volume can overlap with it.
+	if(raSharesController(vol)) raFinish();
+#endif
+	const u8 devNum = g_vols[vol].devNum;
 	if((uintptr_t)buff % 4 == 0)
 	{
 		// Warning! Flush before transfer only works on ARM9 (no speculative prefetching)!
 		flushDCacheRange(buff, 512 * count);
 
-		NdmaCh *const ndmaCh = getNdmaChRegs(5);
-		ndmaCh->sad  = (u32)getTmioFifo(getTmioRegs(1)); // TODO: SDMMC dev to FIFO function.
-		ndmaCh->dad  = (u32)buff;
-		ndmaCh->wcnt = 512 / 4;
-		ndmaCh->bcnt = NDMA_FASTEST;
-		ndmaCh->cnt  = NDMA_EN | NDMA_START_TMIO3 | NDMA_REPEAT_MODE |
-		               NDMA_BURST(64 / 4) | NDMA_SAD_FIX | NDMA_DAD_INC;
+		NdmaCh *const ndmaCh = startTmioDma(vol, buff, false);
 
 		do
 		{
 			const u16 blockCount = (count > 0xFFFF ? 0xFFFF : count);
-			if(SDMMC_readSectors(SDMMC_DEV_CARD, sector, NULL, blockCount) != SDMMC_ERR_NONE)
+			if(SDMMC_readSectors(devNum, sector, NULL, blockCount) != SDMMC_ERR_NONE)
 			{
 				res = RES_ERROR;
 				break;
@@ -104,20 +467,23 @@ DRESULT disk_read (
 	}
 	else
 	{
-		// TODO: More optimization. For unaligned buffers we could use a bounce buffer but it costs extra memory.
+#if DISKIO_BOUNCE_SECTORS > 0
+		res = readBounced(vol, buff, sector, count);
+#else
 		do
 		{
 			const u16 blockCount = (count > 0xFFFF ? 0xFFFF : count);
-			if(SDMMC_readSectors(SDMMC_DEV_CARD, sector, buff, blockCount) != SDMMC_ERR_NONE)
+			if(SDMMC_readSectors(devNum, sector, buff, blockCount) != SDMMC_ERR_NONE)
 			{
 				res = RES_ERROR;
 				break;
 			}
 
-			buff += blockCount;
+			buff += 512 * blockCount;
 			sector += blockCount;
 			count -= blockCount;
 		} while(count > 0);
+#endif // #if DISKIO_BOUNCE_SECTORS > 0
 	}
 
 	return res;
@@ -125,38 +491,62 @@ DRESULT disk_read (
 
 
 
-/*-----------------------------------------------------------------------*/
-/* Write Sector(s)                                                       */
-/*-----------------------------------------------------------------------*/
+#if DISKIO_TRIM_QUEUE > 0
+// Sectors written to the card must not be erased afterwards.
+// Keeps the larger part of an overlapping range.
+static void trimCancelRange(const u8 vol, const LBA_t sector, const LBA_t count)
+{
+	const LBA_t end = sector + count;
+	u32 i = 0;
+	while(i < g_trim.num)
+	{
+		TrimRange *const range = &g_trim.ranges[i];
+		const LBA_t rangeEnd = range->sector + range->count;
+		if(range->vol == vol && sector < rangeEnd && range->sector < end)
+		{
+			const LBA_t before = (sector > range->sector ? sector - range->sector : 0);
+			const LBA_t after  = (rangeEnd > end ? rangeEnd - end : 0);
+			if(before >= after) range->count = before;
+			else
+			{
+				range->sector = end;
+				range->count  = after;
+			}
 
-#if FF_FS_READONLY == 0
+			if(range->count == 0)
+			{
+				*range = g_trim.ranges[--g_trim.num];
+				continue;
+			}
+		}
+		i++;
+	}
+}
+#endif // #if DISKIO_TRIM_QUEUE > 0
 
-DRESULT disk_write (
-	BYTE pdrv,			/* Physical drive nmuber to identify the drive */
-	const BYTE *buff,	/* Data to be written */
-	LBA_t sector,		/* Start sector in LBA */
-	UINT count			/* Number of sectors to write */
-)
+#if FF_FS_READONLY == 0
+static DRESULT writeSectors(const u8 vol, const BYTE *buff, LBA_t sector, UINT count)
 {
-	(void)pdrv;
-
 	DRESULT res = RES_OK;
+#if DISKIO_TRIM_QUEUE > 0
+	trimCancelRange(vol, sector, count);
+#endif
+#if DISKIO_READAHEAD_SECTORS > 0
+	// Also waits for the read-ahead transfer which uses the same DMA channel.
+	raInvalidateRange(vol, sector, count);
+	if(raSharesController(vol)) raFinish();
+#endif
+	const u8 devNum = g_vols[vol].devNum;
 	if((uintptr_t)buff % 4 == 0)
 	{
 		flushDCacheRange(buff, 512 * count);
 
-		NdmaCh *const ndmaCh = getNdmaChRegs(5);
-		ndmaCh->sad  = (u32)buff;
-		ndmaCh->dad  = (u32)getTmioFifo(getTmioRegs(1)); // TODO: SDMMC dev to FIFO function.
-		ndmaCh->wcnt = 512 / 4;
-		ndmaCh->bcnt = NDMA_FASTEST;
-		ndmaCh->cnt  = NDMA_EN | NDMA_START_TMIO3 | NDMA_REPEAT_MODE |
-		               NDMA_BURST(64 / 4) | NDMA_SAD_INC | NDMA_DAD_FIX;
+		NdmaCh *const ndmaCh = startTmioDma(vol, buff, true);
 
 		do
 		{
 			const u16 blockCount = (count > 0xFFFF ? 0xFFFF : count);
-			if(SDMMC_writeSectors(SDMMC_DEV_CARD, sector, NULL, blockCount) != SDMMC_ERR_NONE)
+			if(SDMMC_writeSectors(devNum, sector, NULL, blockCount) != SDMMC_ERR_NONE)
 			{
 				res = RES_ERROR;
 				break;
@@ -174,21 +564,590 @@ DRESULT disk_write (
 	}
 	else
 	{
-		// TODO: More optimization. For unaligned buffers we could use a bounce buffer but it costs extra memory.
+#if DISKIO_BOUNCE_SECTORS > 0
+		res = writeBounced(vol, buff, sector, count);
+#else
 		do
 		{
 			const u16 blockCount = (count > 0xFFFF ? 0xFFFF : count);
-			if(SDMMC_writeSectors(SDMMC_DEV_CARD, sector, buff, blockCount) != SDMMC_ERR_NONE)
+			if(SDMMC_writeSectors(devNum, sector, buff, blockCount) != SDMMC_ERR_NONE)
 			{
 				res = RES_ERROR;
 				break;
 			}
 
-			buff += blockCount;
+			buff += 512 * blockCount;
 			sector += blockCount;
 			count -= blockCount;
 		} while(count > 0);
+#endif // #if DISKIO_BOUNCE_SECTORS > 0
+	}
+
+	return res;
+}
+#endif // #if FF_FS_READONLY == 0
+
+#if DISKIO_COALESCE_SECTORS > 0
+static DRESULT wcFlush(void)
+{
+	const u32 count = g_wc.count;
+	if(count == 0) return RES_OK;
+
+	g_wc.count = 0;
+	g_stats.coalesceFlushes++;
+
+	return writeSectors(g_wc.vol, g_wcBuf, g_wc.start, count);
+}
+
+// Buffered sectors must reach the card before they are read or rewritten elsewhere.
+static DRESULT wcFlushRange(const u8 vol, const LBA_t sector, const UINT count)
+{
+	if(g_wc.count > 0 && vol == g_wc.vol && sector < g_wc.start + g_wc.count && g_wc.start < sector + count)
+		return wcFlush();
+
+	return RES_OK;
+}
+
+// Merges sequential multi-sector writes and splits them at allocation unit boundaries.
+// Writes crossing an AU boundary cause read-modify-write cycles inside the card.
+static DRESULT coalescedWrite(const u8 vol, const BYTE *buff, LBA_t sector, UINT count)
+{
+	DRESULT res = RES_OK;
+	if(g_wc.count > 0 && (vol != g_wc.vol || sector != g_wc.start + g_wc.count)) res = wcFlush();
+
+	// Flush at AU boundaries.
+	const u32 auSize = getAuSize(vol);
+	const u32 align = (auSize > 0 ? auSize : DISKIO_COALESCE_SECTORS);
+	while(count > 0 && res == RES_OK)
+	{
+		const u32 toBoundary = align - (sector & (align - 1));
+		u32 n;
+		if(g_wc.count == 0 && count >= DISKIO_COALESCE_SECTORS)
+		{
+			// Big writes go straight to the card.
+			n = (count < toBoundary ? count : toBoundary);
+			res = writeSectors(vol, buff, sector, n);
+		}
+		else
+		{
+			n = DISKIO_COALESCE_SECTORS - g_wc.count;
+			if(n > count)      n = count;
+			if(n > toBoundary) n = toBoundary;
+
+			if(g_wc.count == 0)
+			{
+				g_wc.start = sector;
+				g_wc.vol   = vol;
+			}
+			memcpy(&g_wcBuf[g_wc.count * 512], buff, n * 512);
+			g_wc.count += n;
+			g_stats.coalescedSectors += n;
+
+			if(g_wc.count == DISKIO_COALESCE_SECTORS || n == toBoundary) res = wcFlush();
+		}
+
+		buff += n * 512;
+		sector += n;
+		count -= n;
+	}
+
+	return res;
+}
+#endif // #if DISKIO_COALESCE_SECTORS > 0
+
+#if DISKIO_CACHE_SECTORS > 0
+static CacheLine* cacheLookup(const u8 vol, const LBA_t sector)
+{
+	CacheLine *const set = &g_cache.lines[(sector & (CACHE_SETS - 1)) * DISKIO_CACHE_WAYS];
+	for(u32 i = 0; i < DISKIO_CACHE_WAYS; i++)
+	{
+		CacheLine *const line = &set[i];
+		if((line->state & CACHE_VALID) && line->sector == sector && line->vol == vol) return line;
+	}
+
+	return NULL;
+}
+
+ALWAYS_INLINE u8* cacheLineData(const CacheLine *const line)
+{
+	return g_cacheData[line - g_cache.lines];
+}
+
+ALWAYS_INLINE void cacheTouch(CacheLine *const line)
+{
+	line->lastUse = ++g_cache.tick;
+}
+
+#if FF_FS_READONLY == 0
+static DRESULT cacheWriteBack(CacheLine *const line)
+{
+	const DRESULT res = writeSectors(line->vol, cacheLineData(line), line->sector, 1);
+	if(res == RES_OK)
+	{
+		line->state &= ~CACHE_DIRTY;
+		g_stats.writeBacks++;
+	}
+
+	return res;
+}
+#endif // #if FF_FS_READONLY == 0
+
+// Picks a free or the least recently used line of the same or lower priority.
+// Lines with higher priority are pinned against lower priority sectors.
+// Returns NULL if all ways are pinned or the dirty victim couldn't be written back.
+static CacheLine* cacheAlloc(const u8 vol, const LBA_t sector, const u8 prio)
+{
+	CacheLine *const set = &g_cache.lines[(sector & (CACHE_SETS - 1)) * DISKIO_CACHE_WAYS];
+	CacheLine *victim = NULL;
+	for(u32 i = 0; i < DISKIO_CACHE_WAYS; i++)
+	{
+		CacheLine *const line = &set[i];
+		if(!(line->state & CACHE_VALID))
+		{
+			victim = line;
+			break;
+		}
+		if(line->prio > prio) continue;
+
+		// Evict lower priority first and LRU within the same priority.
+		if(victim == NULL || line->prio < victim->prio ||
+		   (line->prio == victim->prio && line->lastUse < victim->lastUse))
+			victim = line;
+	}
+	if(victim == NULL) return NULL;
+
+#if FF_FS_READONLY == 0
+	if(victim->state & CACHE_DIRTY)
+	{
+		if(cacheWriteBack(victim) != RES_OK) return NULL;
+	}
+#endif // #if FF_FS_READONLY == 0
+
+	victim->sector = sector;
+	victim->state  = 0;
+	victim->prio   = prio;
+	victim->vol    = vol;
+
+	return victim;
+}
+
+ALWAYS_INLINE bool cacheIsFat(const u8 vol, const LBA_t sector)
+{
+	return sector >= g_cache.fatStart[vol] && sector < g_cache.fatEnd[vol];
+}
+
+static u8 cacheSectorPrio(const u8 vol, const LBA_t sector, const bool isWindow)
+{
+	if(!isWindow) return CACHE_PRIO_DATA;
+
+	return (cacheIsFat(vol, sector) ? CACHE_PRIO_FAT : CACHE_PRIO_DIR);
+}
+
+static DRESULT cachedRead(const u8 vol, BYTE *const buff, const LBA_t sector, const bool isWindow)
+{
+	CacheLine *line = cacheLookup(vol, sector);
+	if(line != NULL)
+	{
+		g_stats.hits++;
+
+		// Data sectors read through the window get promoted.
+		const u8 prio = cacheSectorPrio(vol, sector, isWindow);
+		if(prio > line->prio) line->prio = prio;
+	}
+	else
+	{
+		g_stats.misses++;
+
+		line = cacheAlloc(vol, sector, cacheSectorPrio(vol, sector, isWindow));
+		if(line == NULL)
+		{
+			g_stats.bypasses++;
+			return readSectors(vol, buff, sector, 1);
+		}
+
+		const DRESULT res = readSectors(vol, cacheLineData(line), sector, 1);
+		if(res != RES_OK) return res;
+		line->state = CACHE_VALID;
+	}
+	cacheTouch(line);
+
+	memcpy(buff, cacheLineData(line), 512);
+
+	return RES_OK;
+}
+
+// The cache holds the latest data for dirty sectors.
+static void cacheOverlayDirty(const u8 vol, BYTE *const buff, const LBA_t sector, const UINT count)
+{
+	for(u32 i = 0; i < DISKIO_CACHE_SECTORS; i++)
+	{
+		const CacheLine *const line = &g_cache.lines[i];
+		const LBA_t lineSector = line->sector;
+		if((line->state & CACHE_DIRTY) && line->vol == vol && lineSector >= sector && lineSector - sector < count)
+			memcpy(&buff[(lineSector - sector) * 512], cacheLineData(line), 512);
+	}
+}
+
+#if FF_FS_READONLY == 0
+static DRESULT cachedWrite(const u8 vol, const BYTE *const buff, const LBA_t sector)
+{
+	CacheLine *line = cacheLookup(vol, sector);
+	if(line == NULL)
+	{
+		line = cacheAlloc(vol, sector, (cacheIsFat(vol, sector) ? CACHE_PRIO_FAT : CACHE_PRIO_DATA));
+		if(line == NULL)
+		{
+			g_stats.bypasses++;
+			return writeSectors(vol, buff, sector, 1);
+		}
+	}
+	cacheTouch(line);
+
+	memcpy(cacheLineData(line), buff, 512);
+	line->state = CACHE_VALID | CACHE_DIRTY;
+
+	return RES_OK;
+}
+
+// Keeps cached copies in sync with multi-sector writes that bypass the cache.
+static void cacheUpdateRange(const u8 vol, const BYTE *const buff, const LBA_t sector, const UINT count)
+{
+	for(u32 i = 0; i < DISKIO_CACHE_SECTORS; i++)
+	{
+		CacheLine *const line = &g_cache.lines[i];
+		const LBA_t lineSector = line->sector;
+		if((line->state & CACHE_VALID) && line->vol == vol && lineSector >= sector && lineSector - sector < count)
+		{
+			memcpy(cacheLineData(line), &buff[(lineSector - sector) * 512], 512);
+			line->state = CACHE_VALID;
+		}
+	}
+}
+#endif // #if FF_FS_READONLY == 0
+
+static DRESULT cacheFlush(const u8 vol)
+{
+	DRESULT res = RES_OK;
+#if FF_FS_READONLY == 0
+	for(u32 i = 0; i < DISKIO_CACHE_SECTORS; i++)
+	{
+		CacheLine *const line = &g_cache.lines[i];
+		if((line->state & CACHE_DIRTY) && line->vol == vol)
+		{
+			// Keep going on errors and report the failure at the end.
+			if(cacheWriteBack(line) != RES_OK) res = RES_ERROR;
+		}
 	}
+#else
+	(void)vol;
+#endif // #if FF_FS_READONLY == 0
+
+	return res;
+}
+
+static void cacheInvalidate(const u8 vol)
+{
+	for(u32 i = 0; i < DISKIO_CACHE_SECTORS; i++)
+	{
+		CacheLine *const line = &g_cache.lines[i];
+		if(line->vol == vol) line->state = 0;
+	}
+}
+
+// Drops cached sectors including dirty ones. Used for trimmed ranges.
+static void cacheDiscardRange(const u8 vol, const LBA_t sector, const LBA_t count)
+{
+	for(u32 i = 0; i < DISKIO_CACHE_SECTORS; i++)
+	{
+		CacheLine *const line = &g_cache.lines[i];
+		if(line->vol == vol && line->sector >= sector && line->sector - sector < count) line->state = 0;
+	}
+}
+#endif // #if DISKIO_CACHE_SECTORS > 0
+
+#if FF_FS_READONLY == 0
+static DRESULT eraseSectors(const u8 vol, const LBA_t sector, const LBA_t count)
+{
+#if DISKIO_READAHEAD_SECTORS > 0
+	// The read-ahead transfer must finish before the card can be used.
+	if(raSharesController(vol)) raFinish();
+#endif
+
+	// TRIM is only a hint. Devices without support silently ignore it.
+	const u32 sdmmcRes = SDMMC_eraseSectors(g_vols[vol].devNum, sector, count);
+	if(sdmmcRes == SDMMC_ERR_NONE) g_stats.trimmedSectors += count;
+	else if(sdmmcRes != SDMMC_ERR_NOT_SUPPORTED) return RES_ERROR;
+
+	return RES_OK;
+}
+
+// Drops buffered and cached copies of discarded sectors. Erases them
+// right away or queues them for DISKIO_pollIdle() if defer is true.
+static DRESULT discardSectors(const u8 vol, const LBA_t sector, const LBA_t count, const bool defer)
+{
+#if DISKIO_COALESCE_SECTORS > 0
+	if(wcFlushRange(vol, sector, count) != RES_OK) return RES_ERROR;
+#endif
+#if DISKIO_READAHEAD_SECTORS > 0
+	raInvalidateRange(vol, sector, count);
+#endif
+#if DISKIO_CACHE_SECTORS > 0
+	cacheDiscardRange(vol, sector, count);
+#endif
+
+#if DISKIO_TRIM_QUEUE > 0
+	if(defer)
+	{
+		// FatFs frees cluster chains in order so ranges are often adjacent.
+		for(u32 i = 0; i < g_trim.num; i++)
+		{
+			TrimRange *const range = &g_trim.ranges[i];
+			if(range->vol != vol) continue;
+			if(range->sector + range->count == sector)
+			{
+				range->count += count;
+				return RES_OK;
+			}
+			if(sector + count == range->sector)
+			{
+				range->sector = sector;
+				range->count += count;
+				return RES_OK;
+			}
+		}
+
+		if(g_trim.num < DISKIO_TRIM_QUEUE) g_trim.ranges[g_trim.num++] = (TrimRange){sector, count, vol};
+		else                               g_stats.trimsDropped++;
+
+		return RES_OK;
+	}
+#else
+	(void)defer;
+#endif // #if DISKIO_TRIM_QUEUE > 0
+
+	return eraseSectors(vol, sector, count);
+}
+
+#if DISKIO_TRIM_QUEUE > 0
+// Erases one chunk of the queued ranges.
+static void trimProcess(void)
+{
+	if(g_trim.num == 0) return;
+
+	TrimRange *const range = &g_trim.ranges[g_trim.num - 1];
+	const LBA_t count = (range->count > TRIM_CHUNK_SECTORS ? TRIM_CHUNK_SECTORS : range->count);
+	if(eraseSectors(range->vol, range->sector, count) == RES_OK && range->count > count)
+	{
+		range->sector += count;
+		range->count  -= count;
+	}
+	else g_trim.num--; // Done or failed. Not worth a retry.
+}
+
+static void trimDropVol(const u8 vol)
+{
+	u32 i = 0;
+	while(i < g_trim.num)
+	{
+		if(g_trim.ranges[i].vol == vol) g_trim.ranges[i] = g_trim.ranges[--g_trim.num];
+		else                            i++;
+	}
+}
+#endif // #if DISKIO_TRIM_QUEUE > 0
+#endif // #if FF_FS_READONLY == 0
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Get Drive Status                                                      */
+/*-----------------------------------------------------------------------*/
+
+DSTATUS disk_status (
+	BYTE pdrv		/* Physical drive nmuber to identify the drive */
+)
+{
+	const u8 vol = pdrv & PDRV_MASK;
+	if(vol >= FF_VOLUMES) return STA_NOINIT;
+
+	return SDMMC_getDiskStatus(g_vols[vol].devNum);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Inidialize a Drive                                                    */
+/*-----------------------------------------------------------------------*/
+
+// The eMMC can't be removed. Only init it once.
+static DSTATUS initEmmc(void)
+{
+	if((SDMMC_getDiskStatus(SDMMC_DEV_eMMC) & STA_NOINIT) == 0) return 0;
+
+	return (SDMMC_init(SDMMC_DEV_eMMC) == SDMMC_ERR_NONE ? 0 : STA_NOINIT);
+}
+
+#if DISKIO_IDLE_TIMEOUT_MS > 0
+// Called from the idle clock IRQ. Only FatFs lock holders use the devices
+// so leave them alone while it's taken. The next tick tries again.
+static void idleHandler(void)
+{
+	if(!ff_mutex_take(FF_VOLUMES)) return;
+
+	for(u32 vol = 0; vol < FF_VOLUMES; vol++) SDMMC_pollIdle(g_vols[vol].devNum);
+
+	ff_mutex_give(FF_VOLUMES);
+}
+#endif
+
+DSTATUS disk_initialize (
+	BYTE pdrv				/* Physical drive number to identify the drive */
+)
+{
+	const u8 vol = pdrv & PDRV_MASK;
+	if(vol >= FF_VOLUMES) return STA_NOINIT;
+#if DISKIO_IDLE_TIMEOUT_MS > 0
+	SDMMC_setIdleHandler(idleHandler);
+	SDMMC_setIdleTimeout(g_vols[vol].devNum, DISKIO_IDLE_TIMEOUT_MS);
+#endif
+	if(g_vols[vol].devNum == SDMMC_DEV_eMMC) return initEmmc();
+
+	// Workaround for card detect time.
+	unsigned timeout = 5;
+	while(!TMIO_cardDetected() && timeout > 0)
+	{
+		TIMER_sleepMs(2);
+		timeout--;
+	}
+
+	if(timeout == 0)
+		return STA_NODISK | STA_NOINIT;
+
+	// Reattach if there was no insert/remove event and the card still
+	// responds. The driver state may have been reset in the meantime.
+	// The sector cache stays valid in this case.
+	if(g_devCache.valid)
+	{
+		SDMMC_importDevState(SDMMC_DEV_CARD, g_devCache.state); // Fails if still initialized.
+		if(SDMMC_verifyDevState(SDMMC_DEV_CARD) == SDMMC_ERR_NONE)
+		{
+			g_stats.reattaches++;
+			return 0;
+		}
+		g_devCache.valid = false;
+	}
+
+	// The card may have been swapped.
+#if DISKIO_CACHE_SECTORS > 0
+	cacheInvalidate(vol);
+#endif
+#if DISKIO_READAHEAD_SECTORS > 0
+	if(g_ra.vol == vol)
+	{
+		raCancel();
+		g_ra.nextSector = 0;
+	}
+#endif
+#if DISKIO_COALESCE_SECTORS > 0
+	if(g_wc.vol == vol) g_wc.count = 0;
+#endif
+#if DISKIO_TRIM_QUEUE > 0
+	trimDropVol(vol);
+#endif
+
+	SDMMC_deinit(SDMMC_DEV_CARD);
+	if(SDMMC_init(SDMMC_DEV_CARD) != SDMMC_ERR_NONE) return STA_NOINIT;
+	g_devCache.valid = SDMMC_exportDevState(SDMMC_DEV_CARD, g_devCache.state) == SDMMC_ERR_NONE;
+
+	return 0;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s)                                                        */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_read (
+	BYTE pdrv,		/* Physical drive nmuber to identify the drive */
+	BYTE *buff,		/* Data buffer to store read data */
+	LBA_t sector,	/* Start sector in LBA */
+	UINT count		/* Number of sectors to read */
+)
+{
+	// Bit 7 marks reads into the FatFs window (FAT and directory sectors).
+	const bool isWindow = (pdrv & 0x80u) != 0;
+	const u8 vol = pdrv & PDRV_MASK;
+	if(vol >= FF_VOLUMES || !isValidRange(vol, sector, count)) return RES_PARERR;
+
+#if DISKIO_COALESCE_SECTORS > 0
+	if(wcFlushRange(vol, sector, count) != RES_OK) return RES_ERROR;
+#endif
+
+#if DISKIO_CACHE_SECTORS > 0
+	if(count == 1) return cachedRead(vol, buff, sector, isWindow);
+#endif
+
+	DRESULT res;
+#if DISKIO_READAHEAD_SECTORS > 0
+	// Only multi-sector data reads take part in read-ahead.
+	if(isWindow || count == 1 || !raRead(vol, buff, sector, count))
+	{
+		res = readSectors(vol, buff, sector, count);
+
+		// Prefetch after the second sequential read in a row.
+		if(res == RES_OK && !isWindow && count > 1 && g_ra.sequential && g_ra.window > 0)
+			raStart(vol, sector + count);
+	}
+	else res = RES_OK;
+#else
+	(void)isWindow;
+	res = readSectors(vol, buff, sector, count);
+#endif // #if DISKIO_READAHEAD_SECTORS > 0
+
+#if DISKIO_CACHE_SECTORS > 0
+	if(res == RES_OK) cacheOverlayDirty(vol, buff, sector, count);
+#endif
+
+	return res;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s)                                                       */
+/*-----------------------------------------------------------------------*/
+
+#if FF_FS_READONLY == 0
+
+DRESULT disk_write (
+	BYTE pdrv,			/* Physical drive nmuber to identify the drive */
+	const BYTE *buff,	/* Data to be written */
+	LBA_t sector,		/* Start sector in LBA */
+	UINT count			/* Number of sectors to write */
+)
+{
+	const u8 vol = pdrv & PDRV_MASK;
+	if(vol >= FF_VOLUMES || !isValidRange(vol, sector, count)) return RES_PARERR;
+
+#if DISKIO_CACHE_SECTORS > 0
+	// Single sectors are written back on CTRL_SYNC or eviction.
+	if(count == 1)
+	{
+#if DISKIO_COALESCE_SECTORS > 0
+		if(wcFlushRange(vol, sector, 1) != RES_OK) return RES_ERROR;
+#endif
+		return cachedWrite(vol, buff, sector);
+	}
+#endif // #if DISKIO_CACHE_SECTORS > 0
+
+#if DISKIO_COALESCE_SECTORS > 0
+	const DRESULT res = coalescedWrite(vol, buff, sector, count);
+#else
+	const DRESULT res = writeSectors(vol, buff, sector, count);
+#endif
+#if DISKIO_CACHE_SECTORS > 0
+	if(res == RES_OK) cacheUpdateRange(vol, buff, sector, count);
+#endif
 
 	return res;
 }
@@ -206,26 +1165,184 @@ DRESULT disk_ioctl (
 	void *buff		/* Buffer to send/receive control data */
 )
 {
-	(void)pdrv;
+	const u8 vol = pdrv & PDRV_MASK;
+	if(vol >= FF_VOLUMES) return RES_PARERR;
 
 	DRESULT res = RES_OK;
 	switch(cmd)
 	{
 		case GET_SECTOR_COUNT:
-			*(DWORD*)buff = SDMMC_getSectors(SDMMC_DEV_CARD);
+			*(LBA_t*)buff = SDMMC_getSectors(g_vols[vol].devNum);
 			break;
 		case GET_SECTOR_SIZE:
 			*(WORD*)buff = 512;
 			break;
 		case GET_BLOCK_SIZE:
-			*(DWORD*)buff = 0x100; // Default to 128 KiB. TODO: Get this from the driver.
+			{
+				// Default to 128 KiB if the card doesn't report an AU size.
+				const u32 auSize = getAuSize(vol);
+				*(DWORD*)buff = (auSize > 0 ? auSize : 0x100);
+			}
+			break;
+#if FF_FS_READONLY == 0
 		case CTRL_TRIM:
-			// TODO: Implement this.
+			{
+				// Inclusive start and end sector.
+				const LBA_t *const range = (const LBA_t*)buff;
+				const LBA_t sector = range[0];
+				if(range[1] < sector || !isValidRange(vol, sector, range[1] - sector + 1))
+				{
+					res = RES_PARERR;
+					break;
+				}
+
+				// This runs in the PXI IRQ handler. Don't wait for the erase here.
+				res = discardSectors(vol, sector, range[1] - sector + 1, true);
+			}
+			break;
+#endif // #if FF_FS_READONLY == 0
 		case CTRL_SYNC:
+#if DISKIO_COALESCE_SECTORS > 0
+			if(g_wc.vol == vol) res = wcFlush();
+#endif
+#if DISKIO_CACHE_SECTORS > 0
+			if(cacheFlush(vol) != RES_OK) res = RES_ERROR;
+#endif
 			break;
 		default:
 			res = RES_PARERR;
 	}
 
 	return res;
-}
\ No newline at end of file
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Cache Control and Statistics                                          */
+/*-----------------------------------------------------------------------*/
+
+void DISKIO_setFatRegion(BYTE pdrv, LBA_t start, LBA_t end)
+{
+#if DISKIO_CACHE_SECTORS > 0
+	const u8 vol = pdrv & PDRV_MASK;
+	if(vol >= FF_VOLUMES) return;
+
+	g_cache.fatStart[vol] = start;
+	g_cache.fatEnd[vol]   = end;
+#else
+	(void)pdrv;
+	(void)start;
+	(void)end;
+#endif
+}
+
+void DISKIO_setReadAhead(u32 sectors)
+{
+#if DISKIO_READAHEAD_SECTORS > 0
+	if(sectors > DISKIO_READAHEAD_SECTORS) sectors = DISKIO_READAHEAD_SECTORS;
+
+	// Don't shrink the window under an in flight transfer.
+	raCancel();
+	g_ra.window = sectors;
+#else
+	(void)sectors;
+#endif
+}
+
+void DISKIO_pollIdle(void)
+{
+	// PXI commands run from the IRQ handler. Keep them from sending
+	// commands in the middle of a sleep transition.
+	// All volumes share one lock (see ffsystem.c).
+	if(!ff_mutex_take(FF_VOLUMES)) return;
+
+#if DISKIO_TRIM_QUEUE > 0
+	// Erasing keeps the device awake until the queue is empty.
+	trimProcess();
+#endif
+
+	// Uninitialized devices are skipped by the driver.
+	for(u32 vol = 0; vol < FF_VOLUMES; vol++) SDMMC_pollIdle(g_vols[vol].devNum);
+
+	ff_mutex_give(FF_VOLUMES);
+}
+
+#if FF_FS_READONLY == 0
+static DRESULT trimClusters(const FATFS *const fs, const DWORD clst, const DWORD num)
+{
+	// Explicit request. Erase right away instead of queuing.
+	const LBA_t sector = fs->database + (LBA_t)(clst - 2) * fs->csize;
+	return discardSectors(fs->pdrv & PDRV_MASK, sector, (LBA_t)num * fs->csize, false);
+}
+
+// FAT12 (tiny volumes) and exFAT are skipped.
+bool DISKIO_discardFree(const FATFS *const fs)
+{
+	const BYTE fsType = fs->fs_type;
+	if(fsType != FS_FAT16 && fsType != FS_FAT32) return true;
+	const u8 vol = fs->pdrv & PDRV_MASK;
+
+	// Bypasses FatFs so lock the volumes ourself. See DISKIO_pollIdle().
+	if(!ff_mutex_take(FF_VOLUMES)) return false;
+
+	// Read the FAT in chunks bypassing the sector cache. It would only evict useful sectors.
+	alignas(32) static u8 fatBuf[DISCARD_FAT_SECTORS * 512];
+	const u32 entriesPerSector = (fsType == FS_FAT32 ? 128 : 256);
+	const DWORD nFatEnt = fs->n_fatent;
+	const LBA_t fatEnd = fs->fatbase + (nFatEnt + entriesPerSector - 1) / entriesPerSector;
+	LBA_t fatSector = fs->fatbase;
+	DWORD clst = 0;
+	DWORD runStart = 0;
+	DWORD runLen = 0;
+	DRESULT res = RES_OK;
+	while(clst < nFatEnt && res == RES_OK)
+	{
+		const UINT count = (fatEnd - fatSector > DISCARD_FAT_SECTORS ? DISCARD_FAT_SECTORS : fatEnd - fatSector);
+		res = readSectors(vol, fatBuf, fatSector, count);
+		if(res != RES_OK) break;
+#if DISKIO_CACHE_SECTORS > 0
+		cacheOverlayDirty(vol, fatBuf, fatSector, count);
+#endif
+
+		const u16 *const fat16 = (const u16*)fatBuf;
+		const u32 *const fat32 = (const u32*)fatBuf;
+		const u32 entries = count * entriesPerSector;
+		for(u32 i = 0; i < entries && clst < nFatEnt; i++, clst++)
+		{
+			// Entry 0 and 1 are reserved.
+			if(clst < 2) continue;
+
+			const u32 entry = (fsType == FS_FAT32 ? fat32[i] & 0x0FFFFFFFu : fat16[i]);
+			if(entry == 0)
+			{
+				if(runLen == 0) runStart = clst;
+				runLen++;
+			}
+			else if(runLen > 0)
+			{
+				res = trimClusters(fs, runStart, runLen);
+				runLen = 0;
+				if(res != RES_OK) break;
+			}
+		}
+
+		fatSector += count;
+	}
+	if(res == RES_OK && runLen > 0) res = trimClusters(fs, runStart, runLen);
+
+	ff_mutex_give(FF_VOLUMES);
+
+	return res == RES_OK;
+}
+#endif // #if FF_FS_READONLY == 0
+
+void DISKIO_getStats(DiskioStats *const statsOut)
+{
+	*statsOut = g_stats;
+}
+
+void DISKIO_resetStats(void)
+{
+	memset(&g_stats, 0, sizeof(DiskioStats));
+}
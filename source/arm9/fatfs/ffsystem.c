@@ -39,7 +39,7 @@ void ff_memfree (
 /* Definitions of Mutex                                                   */
 /*------------------------------------------------------------------------*/
 
-#define OS_TYPE	0	/* 0:Win32, 1:uITRON4.0, 2:uC/OS-II, 3:FreeRTOS, 4:CMSIS-RTOS */
+#define OS_TYPE	5	/* 0:Win32, 1:uITRON4.0, 2:uC/OS-II, 3:FreeRTOS, 4:CMSIS-RTOS, 5:ARM9 (no OS) */
 
 
 #if   OS_TYPE == 0	/* Win32 */
@@ -64,6 +64,17 @@ static SemaphoreHandle_t Mutex[FF_VOLUMES + 1];	/* Table of mutex handle */
 #include "cmsis_os.h"
 static osMutexId Mutex[FF_VOLUMES + 1];	/* Table of mutex ID */
 
+#elif OS_TYPE == 5	/* ARM9 (no OS) */
+#include "types.h"
+#include "arm9/drivers/interrupt.h"
+#include "drivers/pxi.h"
+/* There is no scheduler on the ARM9. The only other FS user is the PXI IRQ handler
+/  and it can't wait for the code it interrupted. Instead PXI commands are held back
+/  while the lock is taken and run when it's released.
+/  The diskio.c caches are shared by all drives so all volumes use the same lock.
+*/
+static volatile bool Locked;
+
 #endif
 
 
@@ -106,6 +117,10 @@ int ff_mutex_create (	/* Returns 1:Function succeeded or 0:Could not create the
 	Mutex[vol] = osMutexCreate(osMutex(cmsis_os_mutex));
 	return (int)(Mutex[vol] != NULL);
 
+#elif OS_TYPE == 5	/* ARM9 (no OS) */
+	(void)vol;
+	return 1;
+
 #endif
 }
 
@@ -138,6 +153,9 @@ void ff_mutex_delete (	/* Returns 1:Function succeeded or 0:Could not delete due
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	osMutexDelete(Mutex[vol]);
 
+#elif OS_TYPE == 5	/* ARM9 (no OS) */
+	(void)vol;
+
 #endif
 }
 
@@ -171,6 +189,17 @@ int ff_mutex_take (	/* Returns 1:Succeeded or 0:Timeout */
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	return (int)(osMutexWait(Mutex[vol], FF_FS_TIMEOUT) == osOK);
 
+#elif OS_TYPE == 5	/* ARM9 (no OS) */
+	(void)vol;
+
+	const u32 savedState = enterCriticalSection();
+	const bool wasLocked = Locked;
+	Locked = true;
+	if(!wasLocked) PXI_setDeferCmds(true);
+	leaveCriticalSection(savedState);
+
+	return (int)!wasLocked;
+
 #endif
 }
 
@@ -201,6 +230,11 @@ void ff_mutex_give (
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	osMutexRelease(Mutex[vol]);
 
+#elif OS_TYPE == 5	/* ARM9 (no OS) */
+	(void)vol;
+	Locked = false;
+	PXI_setDeferCmds(false);
+
 #endif
 }
 
@@ -16,25 +16,129 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include "types.h"
 #include "error_codes.h"
 #include "fs.h"
 #include "fatfs/source/ff.h"
+#include "arm9/diskio.h"
+#include "arm9/drivers/interrupt.h"
+#include "drivers/tmio.h"
+
+
+// Cluster link map entries stored per file handle. Files with more fragments
+// get a map of the exact size from the heap. Each fragment needs 2 entries
+// plus 1 for the map size and 1 for the terminator.
+#ifndef FS_CLMT_INLINE
+#define FS_CLMT_INLINE  (32u)
+#endif
+
+// Number of slots allocated on the first open. The tables double in size when full.
+#ifndef FS_TABLE_MIN_SLOTS
+#define FS_TABLE_MIN_SLOTS  (4u)
+#endif
+
+// Path lookup cache entries. Must be a power of 2. 0 disables the cache.
+// fStat() results are cached. Paths that don't exist are cached too so
+// fOpen() and fOpenDir() can fail without walking the directories again.
+#ifndef FS_PATH_CACHE_ENTRIES
+#define FS_PATH_CACHE_ENTRIES  (32u)
+#endif
+#define PATH_CACHE_MAX_PATH    (128u) // Longer paths are not cached.
+
+// fOpen() fails on dirs and fOpenDir() on files so each lookup type has its own entries.
+enum
+{
+	PATH_CACHE_STAT = 0u,
+	PATH_CACHE_FILE = 1u,
+	PATH_CACHE_DIR  = 2u
+};
+
+// Handles are the slot index with a generation counter in the upper bits.
+// The generation changes on every close so stale handles are detected.
+#define SLOT_BITS         (16u)
+#define SLOT_NONE         ((1u<<SLOT_BITS) - 1) // Also the max number of slots.
+#define MAKE_HANDLE(slot, gen)  ((u32)(gen)<<SLOT_BITS | (slot))
+#define HANDLE_SLOT(h)    ((h) & SLOT_NONE)
+#define HANDLE_GEN(h)     ((h)>>SLOT_BITS)
+
+
+typedef struct
+{
+	u16 index;
+	u16 gen;
+	u16 nextFree; // Next slot in the free list or SLOT_NONE.
+	bool used;
+} SlotHdr;
+
+typedef struct
+{
+	SlotHdr hdr; // Must be the first member.
+	FsFileStats stats;
+	FIL f;
+	DWORD clmt[FS_CLMT_INLINE];
+} FileSlot;
+
+typedef struct
+{
+	SlotHdr hdr; // Must be the first member.
+	DIR d;
+} DirSlot;
+
+typedef struct
+{
+	SlotHdr **slots;   // Slots are allocated one by one so they never move.
+	u32 slotSize;
+	u16 num;           // Allocated slots.
+	u16 cap;           // Size of the slots array.
+	u16 freeHead;
+} HandleTable;
+
+
+#if FS_PATH_CACHE_ENTRIES > 0
+typedef struct
+{
+	u32 hash;       // 0 = unused.
+	u8 type;
+	FRESULT fr;     // FR_OK, FR_NO_FILE or FR_NO_PATH.
+	char path[PATH_CACHE_MAX_PATH];
+	FILINFO fi;     // Only valid with FR_OK.
+} PathCacheEntry;
+#endif // #if FS_PATH_CACHE_ENTRIES > 0
 
 
 static const char *const g_fsPathTable[FS_MAX_DRIVES] = {FS_DRIVE_NAMES};
+
+// Volume to physical drive (see diskio.c) and partition.
+// Partition 0 = first FAT volume found on the drive.
+PARTITION VolToPart[FF_VOLUMES] =
+{
+	{0, 0}, // sdmc: SD card.
+	{1, 0}  // nand: eMMC.
+};
 static struct
 {
 	FATFS fsTable[FS_MAX_DRIVES];
 
-	FIL fTable[FS_MAX_FILES];
-	u32 fBitmap;
-	u32 fHandles;
+	HandleTable files;
+	HandleTable dirs;
+} g_fsState =
+{
+	.files = {.slotSize = sizeof(FileSlot), .freeHead = SLOT_NONE},
+	.dirs  = {.slotSize = sizeof(DirSlot), .freeHead = SLOT_NONE}
+};
 
-	DIR dTable[FS_MAX_DIRS];
-	u32 dBitmap;
-	u32 dHandles;
-} g_fsState = {0};
+#if FS_PATH_CACHE_ENTRIES > 0
+static struct
+{
+	PathCacheEntry entries[FS_PATH_CACHE_ENTRIES];
+	u32 gen;         // Changes on every invalidation.
+	u32 cardChanges; // TMIO_getCardChanges() at the last check. A swapped SD card invalidates all entries.
+	u16 writers;     // Files open for writing. Their entries may change any time.
+	FsPathCacheStats stats;
+} g_pathCache = {0};
+#endif // #if FS_PATH_CACHE_ENTRIES > 0
 
 
 
@@ -44,54 +148,309 @@ static Result fres2Res(FRESULT fr)
 	else            return RES_OK;
 }
 
-static u32 findUnusedFileSlot(void)
+// Adds a new slot to the free list.
+// The PXI IRQ handler may interrupt local FS users so all table accesses are atomic.
+// The heap is not IRQ safe. Allocate outside of the critical section and publish
+// under it. Retries if another context changed the table in the meantime.
+static SlotHdr* allocSlot(HandleTable *const t)
 {
-	if(g_fsState.fHandles >= FS_MAX_FILES) return (u32)-1;
+	SlotHdr *spare = NULL;     // New slot for an empty free list.
+	SlotHdr **newSlots = NULL; // Bigger slot array for a full table.
+	u32 newCap = 0;
+	SlotHdr *hdr = NULL;
+	while(1)
+	{
+		SlotHdr **oldSlots = NULL;
+		const u32 savedState = enterCriticalSection();
+		if(t->freeHead == SLOT_NONE && spare != NULL)
+		{
+			if(t->num == t->cap && newSlots != NULL && newCap > t->cap)
+			{
+				if(t->num > 0) memcpy(newSlots, t->slots, t->num * sizeof(SlotHdr*));
+				oldSlots = t->slots;
+				t->slots = newSlots;
+				t->cap   = newCap;
+				newSlots = NULL;
+			}
+
+			if(t->num < t->cap)
+			{
+				spare->index    = t->num;
+				spare->nextFree = SLOT_NONE;
+				t->slots[t->num] = spare;
+				t->freeHead = t->num++;
+				spare = NULL;
+			}
+		}
+
+		if(t->freeHead != SLOT_NONE)
+		{
+			hdr = t->slots[t->freeHead];
+			t->freeHead = hdr->nextFree;
+			hdr->nextFree = SLOT_NONE;
+			hdr->used = true;
+		}
+		const u32 cap = t->cap;
+		const bool full = t->num == cap;
+		leaveCriticalSection(savedState);
+
+		free(oldSlots);
+		if(hdr != NULL || (full && cap == SLOT_NONE)) break;
+
+		if(spare == NULL)
+		{
+			spare = calloc(1, t->slotSize);
+			if(spare == NULL) break;
+		}
+		if(full && newCap <= cap)
+		{
+			free(newSlots);
+			newCap = (cap > 0 ? cap * 2u : FS_TABLE_MIN_SLOTS);
+			if(newCap > SLOT_NONE) newCap = SLOT_NONE;
+			newSlots = malloc(newCap * sizeof(SlotHdr*));
+			if(newSlots == NULL) break;
+		}
+	}
+
+	// Unused if another context freed or added a slot first.
+	free(spare);
+	free(newSlots);
+
+	return hdr;
+}
+
+static void freeSlot(HandleTable *const t, SlotHdr *const hdr)
+{
+	const u32 savedState = enterCriticalSection();
+	hdr->used = false;
+	hdr->gen++;
+	hdr->nextFree = t->freeHead;
+	t->freeHead = hdr->index;
+	leaveCriticalSection(savedState);
+}
 
-	u32 i = 0;
-	do
+// For iterating over all slots. Returns NULL past the end.
+static SlotHdr* slotAt(const HandleTable *const t, const u32 slot)
+{
+	const u32 savedState = enterCriticalSection();
+	SlotHdr *const hdr = (slot < t->num ? t->slots[slot] : NULL);
+	leaveCriticalSection(savedState);
+
+	return hdr;
+}
+
+static SlotHdr* getSlot(const HandleTable *const t, const u32 h)
+{
+	const u32 slot = HANDLE_SLOT(h);
+	const u32 savedState = enterCriticalSection();
+	SlotHdr *hdr = NULL;
+	if(slot < t->num)
 	{
-		if((g_fsState.fBitmap & BIT(i)) == 0) break;
-	} while(++i < FS_MAX_FILES);
+		hdr = t->slots[slot];
+		if(!hdr->used || hdr->gen != HANDLE_GEN(h)) hdr = NULL;
+	}
+	leaveCriticalSection(savedState);
 
-	return i;
+	return hdr;
 }
 
-static bool isFileHandleValid(FHandle h)
+static void freeTable(HandleTable *const t)
 {
-	if(h > g_fsState.fHandles) return false;
-	else                       return true;
+	for(u32 i = 0; i < t->num; i++) free(t->slots[i]);
+	free(t->slots);
+	t->slots    = NULL;
+	t->num      = 0;
+	t->cap      = 0;
+	t->freeHead = SLOT_NONE;
 }
 
-static u32 findUnusedDirSlot(void)
+static inline FileSlot* getFile(const FHandle h)
 {
-	if(g_fsState.dHandles >= FS_MAX_DIRS) return (u32)-1;
+	return (FileSlot*)getSlot(&g_fsState.files, h);
+}
 
-	u32 i = 0;
-	do
+static inline DirSlot* getDir(const DHandle h)
+{
+	return (DirSlot*)getSlot(&g_fsState.dirs, h);
+}
+
+static void freeLinkMap(FileSlot *const file)
+{
+	FIL *const f = &file->f;
+	if(f->cltbl != file->clmt) free(f->cltbl);
+	f->cltbl = NULL;
+}
+
+// Switches a file to fast seek mode. On failure it stays in normal mode.
+static void createLinkMap(FileSlot *const file)
+{
+	FIL *const f = &file->f;
+	DWORD *tbl = file->clmt;
+	tbl[0] = FS_CLMT_INLINE;
+	f->cltbl = tbl;
+
+	FRESULT fr = f_lseek(f, CREATE_LINKMAP);
+	if(fr == FR_NOT_ENOUGH_CORE)
 	{
-		if((g_fsState.dBitmap & BIT(i)) == 0) break;
-	} while(++i < FS_MAX_DIRS);
+		// FatFs returned the required size in the first entry.
+		const DWORD size = tbl[0];
+		tbl = malloc(size * sizeof(DWORD));
+		if(tbl != NULL)
+		{
+			tbl[0] = size;
+			f->cltbl = tbl;
+			fr = f_lseek(f, CREATE_LINKMAP);
+		}
+	}
+
+	if(fr != FR_OK) freeLinkMap(file);
+}
+
+// Fast seek mode can't grow files. Fall back to normal mode before that happens.
+static void prepareGrow(FileSlot *const file, const FSIZE_t end)
+{
+	FIL *const f = &file->f;
+	if(f->cltbl != NULL && (f->flag & FA_WRITE) && end > f_size(f)) freeLinkMap(file);
+}
+
+#if FS_PATH_CACHE_ENTRIES > 0
+// FNV-1a. Never returns 0.
+static u32 hashPath(const char *path, u32 *const lenOut)
+{
+	u32 hash = 2166136261u;
+	const char *const start = path;
+	while(*path != '\0')
+	{
+		hash ^= (u8)*path++;
+		hash *= 16777619u;
+	}
+	*lenOut = path - start;
 
-	return i;
+	return (hash != 0 ? hash : 1);
 }
 
-static bool isDirHandleValid(DHandle h)
+static inline PathCacheEntry* getPathCacheEntry(const u32 hash, const u8 type)
 {
-	if(h > g_fsState.dHandles) return false;
-	else                       return true;
+	return &g_pathCache.entries[(hash + type) & (FS_PATH_CACHE_ENTRIES - 1)];
 }
 
+// Call with IRQs disabled.
+static void pathCacheClear(void)
+{
+	for(u32 i = 0; i < FS_PATH_CACHE_ENTRIES; i++) g_pathCache.entries[i].hash = 0;
+	g_pathCache.gen++;
+	g_pathCache.stats.invalidations++;
+}
+
+// Entries are stale after a SD card remove/insert event. Call with IRQs disabled.
+static void pathCacheCheckCard(void)
+{
+	const u32 changes = TMIO_getCardChanges();
+	if(changes != g_pathCache.cardChanges)
+	{
+		g_pathCache.cardChanges = changes;
+		pathCacheClear();
+	}
+}
+
+static u32 pathCacheGen(void)
+{
+	const u32 savedState = enterCriticalSection();
+	pathCacheCheckCard();
+	const u32 gen = g_pathCache.gen;
+	leaveCriticalSection(savedState);
+
+	return gen;
+}
+
+// Only PATH_CACHE_STAT entries store a FILINFO.
+static bool pathCacheLookup(const char *const path, const u8 type, FRESULT *const frOut, FILINFO *const fi)
+{
+	u32 len;
+	const u32 hash = hashPath(path, &len);
+	if(len >= PATH_CACHE_MAX_PATH) return false;
+
+	const u32 savedState = enterCriticalSection();
+	pathCacheCheckCard();
+	g_pathCache.stats.lookups++;
+	const PathCacheEntry *const e = getPathCacheEntry(hash, type);
+	const bool hit = g_pathCache.writers == 0 && e->hash == hash && e->type == type &&
+	                 memcmp(e->path, path, len + 1) == 0;
+	if(hit)
+	{
+		*frOut = e->fr;
+		if(e->fr == FR_OK) *fi = e->fi;
+		g_pathCache.stats.hits++;
+	}
+	leaveCriticalSection(savedState);
+
+	return hit;
+}
+
+// gen is the pathCacheGen() value from before the lookup in FatFs.
+static void pathCacheInsert(const char *const path, const u8 type, const u32 gen, const FRESULT fr, const FILINFO *const fi)
+{
+	if(fr != FR_OK && fr != FR_NO_FILE && fr != FR_NO_PATH) return;
+	u32 len;
+	const u32 hash = hashPath(path, &len);
+	if(len >= PATH_CACHE_MAX_PATH) return;
+
+	// A card change during the FatFs call bumps gen here.
+	const u32 savedState = enterCriticalSection();
+	pathCacheCheckCard();
+	if(g_pathCache.writers == 0 && g_pathCache.gen == gen)
+	{
+		PathCacheEntry *const e = getPathCacheEntry(hash, type);
+		e->hash = hash;
+		e->type = type;
+		e->fr   = fr;
+		memcpy(e->path, path, len + 1);
+		if(fr == FR_OK) e->fi = *fi;
+	}
+	leaveCriticalSection(savedState);
+}
+
+static void pathCacheInvalidate(void)
+{
+	const u32 savedState = enterCriticalSection();
+	pathCacheClear();
+	leaveCriticalSection(savedState);
+}
+
+// Caching is paused while files are open for writing.
+static void pathCacheUpdateWriters(const bool opened)
+{
+	const u32 savedState = enterCriticalSection();
+	if(opened) g_pathCache.writers++;
+	else       g_pathCache.writers--;
+	leaveCriticalSection(savedState);
+
+	pathCacheInvalidate();
+}
+#else
+static inline u32 pathCacheGen(void) { return 0; }
+static inline bool pathCacheLookup(UNUSED const char *const path, UNUSED const u8 type, UNUSED FRESULT *const frOut, UNUSED FILINFO *const fi) { return false; }
+static inline void pathCacheInsert(UNUSED const char *const path, UNUSED const u8 type, UNUSED const u32 gen, UNUSED const FRESULT fr, UNUSED const FILINFO *const fi) {}
+static inline void pathCacheInvalidate(void) {}
+static inline void pathCacheUpdateWriters(UNUSED const bool opened) {}
+#endif // #if FS_PATH_CACHE_ENTRIES > 0
+
 Result fMount(FsDrive drive)
 {
 	if(drive >= FS_MAX_DRIVES) return RES_FR_INVALID_DRIVE;
 
-	return fres2Res(f_mount(&g_fsState.fsTable[drive], g_fsPathTable[drive], 1));
+	FATFS *const fs = &g_fsState.fsTable[drive];
+	const FRESULT fr = f_mount(fs, g_fsPathTable[drive], 1);
+	if(fr == FR_OK) DISKIO_setFatRegion(fs->pdrv, fs->fatbase, fs->fatbase + fs->fsize * fs->n_fats);
+	pathCacheInvalidate();
+
+	return fres2Res(fr);
 }
 
 Result fUnmount(FsDrive drive)
 {
 	if(drive >= FS_MAX_DRIVES) return RES_FR_INVALID_DRIVE;
+	pathCacheInvalidate();
 
 	return fres2Res(f_mount(NULL, g_fsPathTable[drive], 0));
 }
@@ -105,35 +464,76 @@ Result fGetFree(FsDrive drive, u64 *const size)
 	Result res = fres2Res(f_getfree(g_fsPathTable[drive], &freeClusters, &fs));
 	if(res == RES_OK)
 	{
-		if(size) *size = (u64)(freeClusters * fs->csize) * 512u;
+		if(size) *size = (u64)freeClusters * fs->csize * 512u;
+	}
+
+	return res;
+}
+
+Result fDiscardFree(FsDrive drive)
+{
+	if(drive >= FS_MAX_DRIVES) return RES_FR_INVALID_DRIVE;
+
+	// The FAT on the card must be up to date or we would discard allocated clusters.
+	const HandleTable *const files = &g_fsState.files;
+	FileSlot *file;
+	for(u32 i = 0; (file = (FileSlot*)slotAt(files, i)) != NULL; i++)
+	{
+		if(file->hdr.used)
+		{
+			const Result res = fres2Res(f_sync(&file->f));
+			if(res != RES_OK) return res;
+		}
 	}
 
+	// Also makes sure the volume is mounted.
+	DWORD freeClusters;
+	FATFS *fs;
+	Result res = fres2Res(f_getfree(g_fsPathTable[drive], &freeClusters, &fs));
+	if(res == RES_OK && !DISKIO_discardFree(fs)) res = RES_FR_DISK_ERR;
+
 	return res;
 }
 
 Result fOpen(FHandle *const hOut, const char *const path, u8 mode)
 {
 	if(hOut == NULL) return RES_INVALID_ARG;
-	const u32 slot = findUnusedFileSlot();
-	if(slot == (u32)-1) return RES_FR_TOO_MANY_OPEN_FILES;
 
-	Result res = fres2Res(f_open(&g_fsState.fTable[slot], path, mode));
+	// Only plain opens of existing files can fail early.
+	const bool modifies = (mode & (FA_WRITE | FA_CREATE_NEW | FA_CREATE_ALWAYS | FA_OPEN_ALWAYS)) != 0;
+	FRESULT fr;
+	if(!modifies && pathCacheLookup(path, PATH_CACHE_FILE, &fr, NULL)) return fres2Res(fr);
+
+	FileSlot *const file = (FileSlot*)allocSlot(&g_fsState.files);
+	if(file == NULL) return RES_FR_TOO_MANY_OPEN_FILES;
+
+	const u32 gen = pathCacheGen();
+	fr = f_open(&file->f, path, mode & ~FS_OPEN_FASTSEEK);
+	if(modifies)          pathCacheInvalidate();
+	else if(fr != FR_OK)  pathCacheInsert(path, PATH_CACHE_FILE, gen, fr, NULL);
+
+	Result res = fres2Res(fr);
 	if(res == RES_OK)
 	{
-		g_fsState.fBitmap |= BIT(slot);
-		g_fsState.fHandles++;
-		*hOut = (FHandle)slot;
+		if(mode & FA_WRITE) pathCacheUpdateWriters(true);
+		if(mode & FS_OPEN_FASTSEEK) createLinkMap(file);
+
+		file->stats = (FsFileStats){0};
+		*hOut = MAKE_HANDLE(file->hdr.index, file->hdr.gen);
 	}
+	else freeSlot(&g_fsState.files, &file->hdr);
 
 	return res;
 }
 
 Result fRead(FHandle h, void *const buf, u32 size, u32 *const bytesRead)
 {
-	if(!isFileHandleValid(h)) return RES_FR_INVALID_OBJECT;
+	FileSlot *const file = getFile(h);
+	if(file == NULL) return RES_FR_INVALID_OBJECT;
 
 	UINT tmpBytesRead;
-	Result res = fres2Res(f_read(&g_fsState.fTable[h], buf, size, &tmpBytesRead));
+	Result res = fres2Res(f_read(&file->f, buf, size, &tmpBytesRead));
+	file->stats.bytesRead += tmpBytesRead;
 
 	if(bytesRead != NULL) *bytesRead = tmpBytesRead;
 
@@ -142,10 +542,14 @@ Result fRead(FHandle h, void *const buf, u32 size, u32 *const bytesRead)
 
 Result fWrite(FHandle h, const void *const buf, u32 size, u32 *const bytesWritten)
 {
-	if(!isFileHandleValid(h)) return RES_FR_INVALID_OBJECT;
+	FileSlot *const file = getFile(h);
+	if(file == NULL) return RES_FR_INVALID_OBJECT;
+
+	prepareGrow(file, f_tell(&file->f) + size);
 
 	UINT tmpBytesWritten;
-	Result res = fres2Res(f_write(&g_fsState.fTable[h], buf, size, &tmpBytesWritten));
+	Result res = fres2Res(f_write(&file->f, buf, size, &tmpBytesWritten));
+	file->stats.bytesWritten += tmpBytesWritten;
 
 	if(bytesWritten != NULL) *bytesWritten = tmpBytesWritten;
 
@@ -154,78 +558,143 @@ Result fWrite(FHandle h, const void *const buf, u32 size, u32 *const bytesWritte
 
 Result fSync(FHandle h)
 {
-	if(!isFileHandleValid(h)) return RES_FR_INVALID_OBJECT;
+	FileSlot *const file = getFile(h);
+	if(file == NULL) return RES_FR_INVALID_OBJECT;
+
+	return fres2Res(f_sync(&file->f));
+}
+
+Result fAllocate(FHandle h, u64 size, u8 flags)
+{
+	FileSlot *const file = getFile(h);
+	if(file == NULL) return RES_FR_INVALID_OBJECT;
+	if(flags > FS_ALLOC_NOW) return RES_INVALID_ARG;
+
+	// The link map of the empty file is useless once clusters are allocated.
+	const bool fastSeek = file->f.cltbl != NULL;
+	if(fastSeek) freeLinkMap(file);
 
-	return fres2Res(f_sync(&g_fsState.fTable[h]));
+	const Result res = fres2Res(f_expand(&file->f, size, flags));
+	if(fastSeek) createLinkMap(file);
+
+	return res;
 }
 
-Result fLseek(FHandle h, u32 off)
+Result fLseek(FHandle h, u64 off)
 {
-	if(!isFileHandleValid(h)) return RES_FR_INVALID_OBJECT;
+	FileSlot *const file = getFile(h);
+	if(file == NULL) return RES_FR_INVALID_OBJECT;
+	prepareGrow(file, off);
+	file->stats.seeks++;
 
-	return fres2Res(f_lseek(&g_fsState.fTable[h], off));
+	return fres2Res(f_lseek(&file->f, off));
 }
 
-u32 fTell(FHandle h)
+u64 fTell(FHandle h)
 {
-	if(!isFileHandleValid(h)) return 0;
+	const FileSlot *const file = getFile(h);
+	if(file == NULL) return 0;
 
-	return f_tell(&g_fsState.fTable[h]);
+	return f_tell(&file->f);
 }
 
-u32 fSize(FHandle h)
+u64 fSize(FHandle h)
 {
-	if(!isFileHandleValid(h)) return 0;
+	const FileSlot *const file = getFile(h);
+	if(file == NULL) return 0;
 
-	return f_size(&g_fsState.fTable[h]);
+	return f_size(&file->f);
+}
+
+Result fGetStats(FHandle h, FsFileStats *const stats)
+{
+	const FileSlot *const file = getFile(h);
+	if(file == NULL) return RES_FR_INVALID_OBJECT;
+	if(stats == NULL) return RES_INVALID_ARG;
+
+	*stats = file->stats;
+
+	return RES_OK;
 }
 
 Result fClose(FHandle h)
 {
-	if(g_fsState.fHandles == 0 || !isFileHandleValid(h))
-		return RES_FR_INVALID_OBJECT;
+	FileSlot *const file = getFile(h);
+	if(file == NULL) return RES_FR_INVALID_OBJECT;
 
-	Result res = fres2Res(f_close(&g_fsState.fTable[h]));
-	g_fsState.fBitmap &= ~BIT(h);
-	g_fsState.fHandles--;
+	// Size and timestamp are updated on close.
+	const bool writable = (file->f.flag & FA_WRITE) != 0;
+	Result res = fres2Res(f_close(&file->f));
+	if(writable) pathCacheUpdateWriters(false);
+	freeLinkMap(file);
+	freeSlot(&g_fsState.files, &file->hdr);
 
 	return res;
 }
 
 Result fStat(const char *const path, FILINFO *const fi)
 {
-	return fres2Res(f_stat(path, fi));
+	FRESULT fr;
+	if(fi != NULL && pathCacheLookup(path, PATH_CACHE_STAT, &fr, fi)) return fres2Res(fr);
+
+	const u32 gen = pathCacheGen();
+	fr = f_stat(path, fi);
+	if(fi != NULL) pathCacheInsert(path, PATH_CACHE_STAT, gen, fr, fi);
+
+	return fres2Res(fr);
+}
+
+Result fGetPathCacheStats(FsPathCacheStats *const stats)
+{
+	if(stats == NULL) return RES_INVALID_ARG;
+
+#if FS_PATH_CACHE_ENTRIES > 0
+	const u32 savedState = enterCriticalSection();
+	*stats = g_pathCache.stats;
+	leaveCriticalSection(savedState);
+#else
+	*stats = (FsPathCacheStats){0};
+#endif
+
+	return RES_OK;
 }
 
 Result fChdir(const char *const path)
 {
+	// Cached relative paths point somewhere else now.
+	pathCacheInvalidate();
+
 	return fres2Res(f_chdir(path));
 }
 
 Result fOpenDir(DHandle *const hOut, const char *const path)
 {
 	if(hOut == NULL) return RES_INVALID_ARG;
-	const u32 slot = findUnusedDirSlot();
-	if(slot == (u32)-1) return RES_FR_TOO_MANY_OPEN_FILES;
+	FRESULT fr;
+	if(pathCacheLookup(path, PATH_CACHE_DIR, &fr, NULL)) return fres2Res(fr);
 
-	Result res = fres2Res(f_opendir(&g_fsState.dTable[slot], path));
-	if(res == RES_OK)
-	{
-		g_fsState.dBitmap |= BIT(slot);
-		g_fsState.dHandles++;
-		*hOut = (DHandle)slot;
-	}
+	DirSlot *const dir = (DirSlot*)allocSlot(&g_fsState.dirs);
+	if(dir == NULL) return RES_FR_TOO_MANY_OPEN_FILES;
+
+	const u32 gen = pathCacheGen();
+	fr = f_opendir(&dir->d, path);
+	if(fr != FR_OK) pathCacheInsert(path, PATH_CACHE_DIR, gen, fr, NULL);
+
+	Result res = fres2Res(fr);
+	if(res == RES_OK) *hOut = MAKE_HANDLE(dir->hdr.index, dir->hdr.gen);
+	else              freeSlot(&g_fsState.dirs, &dir->hdr);
 
 	return res;
 }
 
 Result fReadDir(DHandle h, FILINFO *const fi, u32 num, u32 *const entriesRead)
 {
-	if(!isDirHandleValid(h)) return RES_FR_INVALID_OBJECT;
+	DirSlot *const slot = getDir(h);
+	if(slot == NULL) return RES_FR_INVALID_OBJECT;
 	// TODO: Check for insanely high num?
 
 	u32 i;
-	DIR *const dir = &g_fsState.dTable[h];
+	DIR *const dir = &slot->d;
 	Result res = RES_OK;
 	for(i = 0; i < num; i++)
 	{
@@ -241,34 +710,55 @@ Result fReadDir(DHandle h, FILINFO *const fi, u32 num, u32 *const entriesRead)
 
 Result fCloseDir(DHandle h)
 {
-	if(g_fsState.dHandles == 0 || !isDirHandleValid(h))
-		return RES_FR_INVALID_OBJECT;
+	DirSlot *const dir = getDir(h);
+	if(dir == NULL) return RES_FR_INVALID_OBJECT;
 
-	Result res = fres2Res(f_closedir(&g_fsState.dTable[h]));
-	g_fsState.dBitmap &= ~BIT(h);
-	g_fsState.dHandles--;
+	Result res = fres2Res(f_closedir(&dir->d));
+	freeSlot(&g_fsState.dirs, &dir->hdr);
 
 	return res;
 }
 
 Result fMkdir(const char *const path)
 {
-	return fres2Res(f_mkdir(path));
+	const Result res = fres2Res(f_mkdir(path));
+	if(res == RES_OK) pathCacheInvalidate();
+
+	return res;
 }
 
 Result fRename(const char *const old, const char *const _new)
 {
-	return fres2Res(f_rename(old, _new));
+	const Result res = fres2Res(f_rename(old, _new));
+	if(res == RES_OK) pathCacheInvalidate();
+
+	return res;
 }
 
 Result fUnlink(const char *const path)
 {
-	return fres2Res(f_unlink(path));
+	const Result res = fres2Res(f_unlink(path));
+	if(res == RES_OK) pathCacheInvalidate();
+
+	return res;
 }
 
 void fsDeinit(void)
 {
-	for(u32 i = 0; i < FS_MAX_FILES; i++)  fClose(i);
+	HandleTable *const files = &g_fsState.files;
+	const SlotHdr *hdr;
+	for(u32 i = 0; (hdr = slotAt(files, i)) != NULL; i++)
+	{
+		if(hdr->used) fClose(MAKE_HANDLE(i, hdr->gen));
+	}
+	HandleTable *const dirs = &g_fsState.dirs;
+	for(u32 i = 0; (hdr = slotAt(dirs, i)) != NULL; i++)
+	{
+		if(hdr->used) fCloseDir(MAKE_HANDLE(i, hdr->gen));
+	}
+	freeTable(files);
+	freeTable(dirs);
+
 	for(u32 i = 0; i < FS_MAX_DRIVES; i++) fUnmount(i);
 
 	// TODO: Deinit drives.
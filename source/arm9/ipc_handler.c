@@ -59,13 +59,13 @@ u32 IPC_handleCmd(u8 cmdId, u32 sendBufs, u32 recvBufs, const u32 *const buf)
 			result = fSync(buf[0]);
 			break;
 		case IPC_CMD_ID_MASK(IPC_CMD9_FLSEEK):
-			result = fLseek(buf[0], buf[1]);
+			result = fLseek(buf[0], (u64)buf[2]<<32 | buf[1]);
 			break;
 		case IPC_CMD_ID_MASK(IPC_CMD9_FTELL):
-			result = fTell(buf[0]);
+			*(u64*)buf[0] = fTell(buf[2]);
 			break;
 		case IPC_CMD_ID_MASK(IPC_CMD9_FSIZE):
-			result = fSize(buf[0]);
+			*(u64*)buf[0] = fSize(buf[2]);
 			break;
 		case IPC_CMD_ID_MASK(IPC_CMD9_FCLOSE):
 			result = fClose(buf[0]);
@@ -94,6 +94,18 @@ u32 IPC_handleCmd(u8 cmdId, u32 sendBufs, u32 recvBufs, const u32 *const buf)
 		case IPC_CMD_ID_MASK(IPC_CMD9_FUNLINK):
 			result = fUnlink((const char *const)buf[0]);
 			break;
+		case IPC_CMD_ID_MASK(IPC_CMD9_FDISCARD_FREE):
+			result = fDiscardFree(buf[0]);
+			break;
+		case IPC_CMD_ID_MASK(IPC_CMD9_FALLOCATE):
+			result = fAllocate(buf[0], (u64)buf[2]<<32 | buf[1], buf[3]);
+			break;
+		case IPC_CMD_ID_MASK(IPC_CMD9_FGET_STATS):
+			result = fGetStats(buf[2], (FsFileStats*)buf[0]);
+			break;
+		case IPC_CMD_ID_MASK(IPC_CMD9_FPATH_STATS):
+			result = fGetPathCacheStats((FsPathCacheStats*)buf[0]);
+			break;
 
 #ifdef LIBN3DS_LEGACY
 		// open_agb_firm specific API.
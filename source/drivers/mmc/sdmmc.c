@@ -22,8 +22,11 @@
 #include "drivers/tmio_config.h"
 #ifdef __ARM9__
 #include "arm9/drivers/timer.h"
+#include "arm9/drivers/interrupt.h"
 #elif __ARM11__
 #include "arm11/drivers/timer.h"
+#include "arm11/drivers/performance_monitor.h"
+#include "kevent.h"
 #endif // #ifdef __ARM9__
 #include "drivers/mmc/mmc_spec.h"
 #include "drivers/mmc/sd_spec.h"
@@ -37,6 +40,18 @@
 #define DEFAULT_CLOCK  (20000000u) // Maximum 20 MHz.
 #define HS_CLOCK       (50000000u) // Maximum 50 MHz.
 
+// Erase in chunks to keep the busy time per command reasonable.
+#define ERASE_MAX_SECTORS  (0x2000u) // 4 MiB.
+#define ERASE_TIMEOUT_MS   (3000u)
+
+// The idle clock wraps around. Keep the timeout below half the period.
+// On ARM9 any timeout in milliseconds fits.
+#ifdef __ARM9__
+#define IDLE_CLOCK_TIMER     (2u) // Reserved while a device with idle timeout is awake. See tmio_config.h.
+#elif __ARM11__
+#define IDLE_TIMEOUT_MAX_MS  (0x7FFFFFFFu / (SDMMC_IDLE_TICK_FREQ / 1000))
+#endif // #ifdef __ARM9__
+
 
 #define MMC_OCR_VOLT_MASK  (MMC_OCR_3_2_3_3V)                        // We support 3.3V only.
 #define SD_OCR_VOLT_MASK   (SD_OCR_3_2_3_3V)                         // We support 3.3V only.
@@ -58,6 +73,13 @@ enum
 
 #define IS_DEV_MMC(dev)  ((dev) < DEV_TYPE_SDSC)
 
+// Bits for SdmmcDev.flags.
+#define DEV_FLAG_TRIM       BIT(0) // (e)MMC supports TRIM.
+#define DEV_FLAG_HS_TIMING  BIT(1) // Card switched to high speed timing.
+#define DEV_FLAG_HS         BIT(2) // Bus runs at high speed clock. Cleared on fallback.
+#define DEV_FLAG_SLEEP      BIT(3) // Deselected (SD) or in sleep state ((e)MMC). Woken up on the next access.
+#define DEV_FLAG_ERASE_SECT BIT(4) // SDSC can only erase whole erase sectors (ERASE_BLK_EN = 0).
+
 
 typedef struct
 {
@@ -69,6 +91,8 @@ typedef struct
 	               // bit 2 permanent write protection (CSD) and bit 3 password protection.
 	u16 rca;       // Relative Card Address (RCA).
 	u16 ccc;       // (e)MMC/SD command class support from CSD. One per bit starting at 0.
+	u8 flags;      // See DEV_FLAG_... defines above.
+	u8 auSize;     // SD AU_SIZE from SD status. 0 = unknown.
 	u32 sectors;   // Size in 512 byte units.
 	u32 status;    // R1 card status on error. Only updated on errors.
 
@@ -76,9 +100,104 @@ typedef struct
 	u32 cid[4];    // Raw CID without the CRC.
 } SdmmcDev;
 
+typedef struct
+{
+	SdmmcReq *head;  // Request currently in flight.
+	SdmmcReq *tail;
+	bool stalled;    // A request failed. Card recovery pending.
+	bool stopTrans;  // Recovery needs STOP_TRANSMISSION.
+	u8 failedDev;    // Device of the failed request.
+} SdmmcQueue;
+
 static SdmmcDev g_devs[2] = {0};
+static SdmmcQueue g_queues[2] = {0};
+static u32 g_cardChanges = 0; // TMIO_getCardChanges() at SD card init/import.
+#if TMIO_STATS
+static SdmmcStats g_stats[2] = {0};
+static_assert(SDMMC_STATS_HIST_BUCKETS == TMIO_STATS_HIST_BUCKETS, "SDMMC and TMIO histogram sizes differ.");
+#endif
+
+// Idle power management. Not part of SdmmcDev to keep the export format.
+typedef struct
+{
+	u32 timeout;    // Inactivity timeout in SDMMC_IDLE_TICK_FREQ ticks. 0 = disabled.
+	u32 lastActive; // getIdleTicks() timestamp of the last access.
+	u32 sleepStart; // TMIO_getStatsTicks() timestamp of the sleep entry. Moved forward when the time asleep is accounted.
+	u8 wakeStep;    // Async wake up progress. 0 = none, 1 = SLEEP_AWAKE sent, 2 = SELECT_CARD sent.
+} SdmmcIdle;
+static SdmmcIdle g_idle[2] = {0};
+#ifdef __ARM9__
+static vu32 g_idleTicks = 0;                  // Incremented by the idle clock timer IRQ.
+static SdmmcIdleHandler g_idleHandler = NULL; // See SDMMC_setIdleHandler().
+#endif // #ifdef __ARM9__
+
+// Async requests only keep one command in flight per controller.
+// Devices sharing a controller (TMIO_CARD_PORT 0) share one queue.
+#define SHARED_QUEUE  (TMIO_CARD_PORT / 2 == TMIO_eMMC_PORT / 2)
+
+
+
+#ifdef __ARM9__
+// Returns true if the device is initialized, awake and has an idle timeout.
+static inline bool idleTimeoutArmed(const u8 devNum)
+{
+	const SdmmcDev *const dev = &g_devs[devNum];
+	return g_idle[devNum].timeout != 0 && dev->type != DEV_TYPE_NONE && !(dev->flags & DEV_FLAG_SLEEP);
+}
+
+static void updateIdleClock(void);
 
+static void idleClockIsr(UNUSED u32 id)
+{
+	const u32 now = ++g_idleTicks;
+
+	bool expired = false;
+	for(u32 i = 0; i < 2; i++)
+	{
+		if(idleTimeoutArmed(i) && now - g_idle[i].lastActive > g_idle[i].timeout) expired = true;
+	}
+	if(expired && g_idleHandler != NULL) g_idleHandler();
+
+	// Stop ticking once all devices are asleep.
+	updateIdleClock();
+}
+#endif // #ifdef __ARM9__
+
+// Starts the idle clock if it's needed and stops it otherwise.
+static void updateIdleClock(void)
+{
+#ifdef __ARM9__
+	// Only runs while a device can time out so the IRQ doesn't wake the CPU
+	// forever. Called from the ISRs too.
+	const u32 savedState = enterCriticalSection();
+	const bool needed = idleTimeoutArmed(SDMMC_DEV_CARD) || idleTimeoutArmed(SDMMC_DEV_eMMC);
+	const bool running = (getTimerRegs(IDLE_CLOCK_TIMER)->cnt & TIMER_EN) != 0;
+	if(needed && !running)
+	{
+		IRQ_registerIsr(IRQ_TIMER_2, idleClockIsr);
+		TIMER_start(IDLE_CLOCK_TIMER, (u16)TIMER_FREQ_1024(SDMMC_IDLE_TICK_FREQ), TIMER_IRQ_EN | TIMER_PRESC_1024);
+	}
+	else if(!needed && running)
+	{
+		TIMER_stop(IDLE_CLOCK_TIMER);
+		IRQ_unregisterIsr(IRQ_TIMER_2);
+	}
+	leaveCriticalSection(savedState);
+#elif __ARM11__
+	// Free running without IRQ. The cycle counter is shared. Leave it running.
+	if(g_idle[0].timeout != 0 || g_idle[1].timeout != 0) perfMonitorCcntDiv64();
+#endif // #ifdef __ARM9__
+}
 
+// Returns the idle clock timestamp in SDMMC_IDLE_TICK_FREQ ticks. Wraps around.
+static inline u32 getIdleTicks(void)
+{
+#ifdef __ARM9__
+	return g_idleTicks;
+#elif __ARM11__
+	return __getCcnt();
+#endif // #ifdef __ARM9__
+}
 
 static u32 sendAppCmd(TmioPort *const port, const u16 cmd, const u32 arg, const u32 rca)
 {
@@ -248,6 +367,17 @@ static inline u32 extractBits(const u32 resp[4], const u32 start, const u32 size
 	return res & mask;
 }
 
+// SDHC/SDXC always have ERASE_BLK_EN set. The SDSC erase sector
+// is SECTOR_SIZE + 1 write blocks of 2^WRITE_BL_LEN bytes.
+static bool sdEraseSectorOnly(const u32 csd[4], const u8 devType)
+{
+	if(devType != DEV_TYPE_SDSC || extractBits(csd, 46, 1) != 0) return false; // [46:46] ERASE_BLK_EN.
+
+	const u32 sector_size  = extractBits(csd, 39, 7); // [45:39]
+	const u32 write_bl_len = extractBits(csd, 22, 4); // [25:22]
+	return (sector_size + 1)<<write_bl_len > 512;
+}
+
 static void parseCsd(SdmmcDev *const dev, const u8 devType, u8 *const spec_vers_out)
 {
 	// Note: The MSBs are in csd[0].
@@ -281,6 +411,8 @@ static void parseCsd(SdmmcDev *const dev, const u8 devType, u8 *const spec_vers_
 	// Else for high capacity (e)MMC the sectors will be read later from EXT_CSD.
 	dev->sectors = sectors;
 
+	if(sdEraseSectorOnly(csd, devType)) dev->flags |= DEV_FLAG_ERASE_SECT;
+
 	// Parse temporary and permanent write protection bits.
 	u8 prot = extractBits(csd, 12, 1)<<1; // [12:12] Not checked by Linux.
 	prot |= extractBits(csd, 13, 1)<<2;   // [13:13]
@@ -312,6 +444,52 @@ static u32 initStandbyState(SdmmcDev *const dev, const u8 devType, const u32 rca
 
 // TODO: Set the timeout based on clock speed (Tmio uses SDCLK for timeouts).
 //       The tmio driver sets a sane default but we should calculate it anyway.
+static u32 sdSwitchFunc(TmioPort *const port, const bool doSwitch, u8 switchStat[64])
+{
+	// Set 64 bytes block length for SWITCH_FUNC status.
+	TMIO_setBlockLen(port, 64);
+
+	// Only touch group 1 (access mode). Function 1 is "High-Speed".
+	TMIO_setBuffer(port, (u32*)switchStat, 1);
+	const u32 arg = SD_SWITCH_FUNC_ARG(doSwitch, 0xF, 0xF, 0xF, 1);
+	const u32 res = TMIO_sendCommand(port, SD_SWITCH_FUNC, arg);
+
+	// Restore default 512 bytes block length.
+	TMIO_setBlockLen(port, 512);
+
+	return res;
+}
+
+static u32 sdSwitchHighSpeed(SdmmcDev *const dev)
+{
+	TmioPort *const port = &dev->port;
+
+	// Check first. Mode 0 doesn't change anything on the card.
+	alignas(4) u8 switchStat[64]; // MSB first and big endian.
+	u32 res = sdSwitchFunc(port, false, switchStat);
+	if(res != 0) return SDMMC_ERR_SWITCH_HS;
+
+	// [415:400] Support Bits of Functions in Function Group 1.
+	// Is group 1, function 1 "High-Speed" supported?
+	if(!(switchStat[63u - 400 / 8] & BIT(1))) return SDMMC_ERR_NONE;
+
+	res = sdSwitchFunc(port, true, switchStat);
+	if(res != 0) return SDMMC_ERR_SWITCH_HS;
+
+	// [379:376] Function Group 1 selection result. 0xF means the switch failed.
+	if((switchStat[63u - 379 / 8] & 0xFu) != 1) return SDMMC_ERR_NONE;
+	dev->flags |= DEV_FLAG_HS_TIMING;
+
+	// High-Speed (max. 50 MHz at 3.3V) supported. Switch to highest supported clock.
+	// Verify with a data transfer and fall back to default speed if that fails.
+	TMIO_setClock(port, HS_CLOCK);
+	res = sdSwitchFunc(port, false, switchStat);
+	if(res == 0) dev->flags |= DEV_FLAG_HS;
+	else         TMIO_setClock(port, DEFAULT_CLOCK);
+
+	return SDMMC_ERR_NONE;
+}
+
 static u32 initTranState(SdmmcDev *const dev, const u8 devType, const u32 rca, const u8 spec_vers)
 {
 	TmioPort *const port = &dev->port;
@@ -331,6 +509,7 @@ static u32 initTranState(SdmmcDev *const dev, const u8 devType, const u32 rca, c
 			u32 res = TMIO_sendCommand(port, MMC_SWITCH, hsArg);
 			if(res != 0) return SDMMC_ERR_SWITCH_HS;
 			TMIO_setClock(port, HS_CLOCK);
+			dev->flags |= DEV_FLAG_HS_TIMING | DEV_FLAG_HS;
 
 			// Switch to 4 bit bus mode.
 			const u32 busWidthArg = MMC_SWITCH_ARG(MMC_SWITCH_ACC_WR_BYTE, EXT_CSD_BUS_WIDTH, 1, 0);
@@ -354,6 +533,9 @@ static u32 initTranState(SdmmcDev *const dev, const u8 devType, const u32 rca, c
 				// byte addressed (e)MMC may set sector count to 0.
 				dev->sectors = ext_csd[EXT_CSD_SEC_COUNT + 3]<<24 | ext_csd[EXT_CSD_SEC_COUNT + 2]<<16 |
 				               ext_csd[EXT_CSD_SEC_COUNT + 1]<<8  | ext_csd[EXT_CSD_SEC_COUNT + 0];
+
+				// SEC_GB_CL_EN means TRIM is supported.
+				if(ext_csd[EXT_CSD_SEC_FEATURE_SUPPORT] & BIT(4)) dev->flags |= DEV_FLAG_TRIM;
 			}
 		}
 	}
@@ -368,26 +550,25 @@ static u32 initTranState(SdmmcDev *const dev, const u8 devType, const u32 rca, c
 		if(res != 0) return SDMMC_ERR_SET_BUS_WIDTH;
 		TMIO_setBusWidth(port, 4);
 
-		if(dev->ccc & BIT(10)) // Class 10 command support.
-		{
-			// Set 64 bytes block length for SWITCH_FUNC status.
-			TMIO_setBlockLen(port, 64);
+		// Get the allocation unit size from the SD status. Only used as a hint
+		// for write alignment so errors are not fatal.
+		// Set 64 bytes block length for SD status.
+		TMIO_setBlockLen(port, 64);
 
-			alignas(4) u8 switchStat[64]; // MSB first and big endian.
-			TMIO_setBuffer(port, (u32*)switchStat, 1);
-			const u32 arg = SD_SWITCH_FUNC_ARG(1, 0xF, 0xF, 0xF, 1);
-			res = TMIO_sendCommand(port, SD_SWITCH_FUNC, arg);
-			if(res != 0) return SDMMC_ERR_SWITCH_HS;
+		alignas(4) u8 sdStatus[64]; // MSB first and big endian.
+		TMIO_setBuffer(port, (u32*)sdStatus, 1);
+		res = sendAppCmd(port, SD_APP_SD_STATUS, 0, rca);
 
-			// Restore default 512 bytes block length.
-			TMIO_setBlockLen(port, 512);
+		// Restore default 512 bytes block length.
+		TMIO_setBlockLen(port, 512);
 
-			// [415:400] Support Bits of Functions in Function Group 1.
-			if(switchStat[63u - 400 / 8] & BIT(1)) // Is group 1, function 1 "High-Speed" supported?
-			{
-				// High-Speed (max. 50 MHz at 3.3V) supported. Switch to highest supported clock.
-				TMIO_setClock(port, HS_CLOCK);
-			}
+		// [431:428] AU_SIZE.
+		dev->auSize = (res == 0 ? sdStatus[63u - 431 / 8]>>4 : 0);
+
+		if(dev->ccc & BIT(10)) // Class 10 command support.
+		{
+			res = sdSwitchHighSpeed(dev);
+			if(res != SDMMC_ERR_NONE) return res;
 		}
 	}
 
@@ -398,11 +579,277 @@ static u32 initTranState(SdmmcDev *const dev, const u8 devType, const u32 rca, c
 	return SDMMC_ERR_NONE;
 }
 
+static u32 updateStatus(SdmmcDev *const dev, const bool stopTransmission)
+{
+	TmioPort *const port = &dev->port;
+
+	// MMC_STOP_TRANSMISSION: Same CMD for (e)MMC/SD. Relies on the driver returning a proper response.
+	// MMC_SEND_STATUS:       Same CMD for (e)MMC/SD but the argument format differs slightly.
+	u32 res;
+	if(stopTransmission) res = TMIO_sendCommand(port, MMC_STOP_TRANSMISSION, 0);
+	else                 res = TMIO_sendCommand(port, MMC_SEND_STATUS, (u32)dev->rca<<16);
+	dev->status = (res == 0 ? port->resp[0] : 0); // Don't update the status with stale data.
+
+	return res;
+}
+
+// Drops to default speed clock on CRC errors in high speed mode.
+// Returns true if the failed transfer should be retried.
+static bool crcFallback(SdmmcDev *const dev, const u32 tmioRes)
+{
+	if(!(tmioRes & STATUS_ERR_CRC) || !(dev->flags & DEV_FLAG_HS)) return false;
+
+	// The card stays in high speed timing which also works at lower clocks.
+	TMIO_setClock(&dev->port, DEFAULT_CLOCK);
+	dev->flags &= ~DEV_FLAG_HS;
+
+	return true;
+}
+
+static void recordTransfer(const u8 devNum, const u8 op, const u16 count, const u32 startTicks, const u32 tmioRes)
+{
+	g_idle[devNum].lastActive = getIdleTicks();
+
+#if TMIO_STATS
+	SdmmcStats *const stats = &g_stats[devNum];
+	const u32 bucket = TMIO_statsBucket(TMIO_getStatsTicks() - startTicks);
+	if(op == SDMMC_REQ_READ)
+	{
+		stats->reads++;
+		if(tmioRes == 0) stats->sectorsRead += count;
+		else             stats->readErrors++;
+		stats->readHist[bucket]++;
+	}
+	else
+	{
+		stats->writes++;
+		if(tmioRes == 0) stats->sectorsWritten += count;
+		else             stats->writeErrors++;
+		stats->writeHist[bucket]++;
+	}
+#else
+	(void)devNum;
+	(void)op;
+	(void)count;
+	(void)startTicks;
+	(void)tmioRes;
+#endif
+}
+
+static void countRetry(const u8 devNum)
+{
+#if TMIO_STATS
+	g_stats[devNum].retries++;
+#else
+	(void)devNum;
+#endif
+}
+
+// Adds the time asleep since the last update to the statistics.
+static void accountSleep(const u8 devNum)
+{
+#if TMIO_STATS
+	SdmmcIdle *const idle = &g_idle[devNum];
+	const u32 now = TMIO_getStatsTicks();
+	g_stats[devNum].asleepTicks += now - idle->sleepStart;
+	idle->sleepStart = now;
+#else
+	(void)devNum;
+#endif
+}
+
+// Updates the sleep flag and statistics after a successful sleep/wake transition.
+static void setAsleep(const u8 devNum, const bool asleep, const bool async)
+{
+	SdmmcDev *const dev = &g_devs[devNum];
+	if(asleep)
+	{
+		dev->flags |= DEV_FLAG_SLEEP;
+#if TMIO_STATS
+		g_idle[devNum].sleepStart = TMIO_getStatsTicks();
+#endif
+	}
+	else
+	{
+		dev->flags &= ~DEV_FLAG_SLEEP;
+		accountSleep(devNum);
+		g_idle[devNum].lastActive = getIdleTicks();
+		updateIdleClock();
+	}
+
+#if TMIO_STATS
+	SdmmcStats *const stats = &g_stats[devNum];
+	if(asleep) stats->sleeps++;
+	else
+	{
+		stats->wakes++;
+		if(async) stats->asyncWakes++;
+	}
+#else
+	(void)async;
+#endif
+}
+
+static void startRequest(SdmmcDev *const dev, SdmmcReq *const req);
+
+ALWAYS_INLINE SdmmcQueue* getQueue(const u8 devNum)
+{
+	return &g_queues[SHARED_QUEUE ? 0 : devNum];
+}
+
+// Completes the request at the head of the queue with the given result.
+static void completeRequest(SdmmcDev *const dev, const u32 res, const bool stopTrans)
+{
+	SdmmcQueue *const queue = getQueue(dev - g_devs);
+	SdmmcReq *const req = queue->head;
+
+	// Dequeue and start the next request before completing this one.
+	// On error the card needs recovery from thread context first.
+	SdmmcReq *const next = req->next;
+	queue->head = next;
+	if(next == NULL) queue->tail = NULL;
+	req->res = res;
+	if(res == SDMMC_ERR_NONE)
+	{
+		if(next != NULL) startRequest(&g_devs[next->devNum], next);
+	}
+	else
+	{
+		queue->stalled   = true;
+		queue->stopTrans = stopTrans;
+		queue->failedDev = dev - g_devs;
+	}
+
+	atomic_store_explicit(&req->done, true, memory_order_release);
+#ifdef __ARM11__
+	if(req->event != 0) signalEvent(req->event, false);
+#endif // #ifdef __ARM11__
+}
+
+static void requestDone(TmioPort *const port, const u32 res)
+{
+	SdmmcDev *const dev = (SdmmcDev*)port; // The port is the first member.
+	const SdmmcReq *const req = getQueue(dev - g_devs)->head;
+	recordTransfer(req->devNum, req->op, req->count, req->startTicks, res);
+
+	completeRequest(dev, (res == 0 ? SDMMC_ERR_NONE : SDMMC_ERR_SECT_RW), req->count > 1);
+}
+
+// Async version of SDMMC_setSleepMode(devNum, false). Runs from the tmio ISR
+// and starts the request at the head of the queue once the device is awake.
+static void wakeDone(TmioPort *const port, const u32 res)
+{
+	SdmmcDev *const dev = (SdmmcDev*)port; // The port is the first member.
+	const u8 devNum = dev - g_devs;
+	SdmmcIdle *const idle = &g_idle[devNum];
+	const u8 step = idle->wakeStep;
+	if(res == 0 && step == 1)
+	{
+		// Select card to go back to transfer state.
+		idle->wakeStep = 2;
+		TMIO_startCommand(port, MMC_SELECT_CARD, (u32)dev->rca<<16, wakeDone);
+		return;
+	}
+	idle->wakeStep = 0;
+
+	if(res == 0)
+	{
+		setAsleep(devNum, false, true);
+		startRequest(dev, getQueue(devNum)->head);
+	}
+	else // The next request after recovery tries again.
+		completeRequest(dev, (step == 1 ? SDMMC_ERR_SLEEP_AWAKE : SDMMC_ERR_SELECT_CARD), false);
+}
+
+static void startWake(SdmmcDev *const dev)
+{
+	// Only (e)MMC has a true sleep mode. SD cards just need to be selected.
+	const u8 step = (IS_DEV_MMC(dev->type) ? 1 : 2);
+	g_idle[dev - g_devs].wakeStep = step;
+	TMIO_startCommand(&dev->port, (step == 1 ? MMC_SLEEP_AWAKE : MMC_SELECT_CARD), (u32)dev->rca<<16, wakeDone);
+}
+
+static void startRequest(SdmmcDev *const dev, SdmmcReq *const req)
+{
+	// The wake up commands run from the ISR like the transfer itself.
+	if(dev->flags & DEV_FLAG_SLEEP)
+	{
+		startWake(dev);
+		return;
+	}
+
+	TmioPort *const port = &dev->port;
+	TMIO_setBuffer(port, req->buf, req->count);
+
+	const u16 count = req->count;
+	u16 cmd;
+	if(req->op == SDMMC_REQ_READ) cmd = (count == 1 ? MMC_READ_SINGLE_BLOCK : MMC_READ_MULTIPLE_BLOCK);
+	else                          cmd = (count == 1 ? MMC_WRITE_BLOCK : MMC_WRITE_MULTIPLE_BLOCK);
+
+	u32 sect = req->sect;
+	const u8 devType = dev->type;
+	if(devType == DEV_TYPE_MMC || devType == DEV_TYPE_SDSC) sect *= 512; // Byte addressing.
+	req->startTicks = TMIO_getStatsTicks();
+	TMIO_startCommand(port, cmd, sect, requestDone);
+}
+
+// Brings the card back to tran state after a failed request and restarts the queue.
+static void recoverQueue(const u8 devNum)
+{
+	SdmmcQueue *const queue = getQueue(devNum);
+	if(!queue->stalled) return;
+
+	// Nothing is in flight while the queue is stalled.
+	updateStatus(&g_devs[queue->failedDev], queue->stopTrans);
+
+	const u32 savedState = enterCriticalSection();
+	queue->stalled = false;
+	SdmmcReq *const head = queue->head;
+	if(head != NULL) startRequest(&g_devs[head->devNum], head);
+	leaveCriticalSection(savedState);
+}
+
+// Waits for all async requests of a device to finish.
+// With a shared queue this includes the requests of the other device.
+static void drainQueue(const u8 devNum)
+{
+	SdmmcQueue *const queue = getQueue(devNum);
+	while(1)
+	{
+		recoverQueue(devNum);
+
+		const u32 savedState = enterCriticalSection();
+		const bool idle = queue->head == NULL;
+		if(!idle) __wfi();
+		leaveCriticalSection(savedState);
+
+		if(idle) break;
+	}
+
+	// Recover from a failure of the last request.
+	recoverQueue(devNum);
+}
+
 ALWAYS_INLINE u8 dev2portNum(const u8 devNum)
 {
 	return (devNum == SDMMC_DEV_eMMC ? TMIO_eMMC_PORT : TMIO_CARD_PORT);
 }
 
+// Returns true if the SD card was removed or inserted since init.
+static bool cardChanged(const u8 devNum)
+{
+	return devNum == SDMMC_DEV_CARD && TMIO_getCardChanges() != g_cardChanges;
+}
+
+// Wakes a sleeping device up before synchronous accesses. The queue must be drained.
+static u32 wakeForAccess(const u8 devNum)
+{
+	g_idle[devNum].lastActive = getIdleTicks();
+	if(!(g_devs[devNum].flags & DEV_FLAG_SLEEP)) return SDMMC_ERR_NONE;
+
+	return SDMMC_setSleepMode(devNum, false);
+}
+
 u32 SDMMC_init(const u8 devNum)
 {
 	if(devNum > SDMMC_MAX_DEV_NUM) return SDMMC_ERR_INVAL_PARAM;
@@ -410,6 +857,9 @@ u32 SDMMC_init(const u8 devNum)
 	SdmmcDev *const dev = &g_devs[devNum];
 	if(dev->type != DEV_TYPE_NONE) return SDMMC_ERR_INITIALIZED;
 
+	// The other device may have requests in flight on a shared controller.
+	drainQueue(devNum);
+
 	// Check SD card write protection slider.
 	if(devNum == SDMMC_DEV_CARD)
 		dev->prot = !TMIO_cardWritable();
@@ -460,6 +910,9 @@ u32 SDMMC_init(const u8 devNum)
 
 	// Only set dev type on successful init.
 	dev->type = devType;
+	if(devNum == SDMMC_DEV_CARD) g_cardChanges = TMIO_getCardChanges();
+	g_idle[devNum].lastActive = getIdleTicks();
+	updateIdleClock();
 
 	return SDMMC_ERR_NONE;
 }
@@ -468,7 +921,14 @@ u32 SDMMC_setSleepMode(const u8 devNum, const bool enabled)
 {
 	if(devNum > SDMMC_MAX_DEV_NUM) return SDMMC_ERR_INVAL_PARAM;
 
+	// Check if the device is initialized.
 	SdmmcDev *const dev = &g_devs[devNum];
+	if(dev->type == DEV_TYPE_NONE) return SDMMC_ERR_NO_CARD;
+	drainQueue(devNum);
+
+	// Nothing to do if the device is already in the requested mode.
+	if(((dev->flags & DEV_FLAG_SLEEP) != 0) == enabled) return SDMMC_ERR_NONE;
+
 	TmioPort *const port = &dev->port;
 	const u32 rca = (u32)dev->rca<<16;
 	const u8 devType = dev->type;
@@ -503,6 +963,31 @@ u32 SDMMC_setSleepMode(const u8 devNum, const bool enabled)
 		u32 res = TMIO_sendCommand(port, MMC_SELECT_CARD, rca);
 		if(res != 0) return SDMMC_ERR_SELECT_CARD;
 	}
+	setAsleep(devNum, enabled, false);
+
+	return SDMMC_ERR_NONE;
+}
+
+u32 SDMMC_setBusMode(const u8 devNum, const u8 mode)
+{
+	if(devNum > SDMMC_MAX_DEV_NUM || mode > SDMMC_BUS_MODE_HS) return SDMMC_ERR_INVAL_PARAM;
+
+	// Check if the device is initialized.
+	SdmmcDev *const dev = &g_devs[devNum];
+	if(dev->type == DEV_TYPE_NONE) return SDMMC_ERR_NO_CARD;
+	drainQueue(devNum);
+
+	if(mode == SDMMC_BUS_MODE_HS)
+	{
+		if(!(dev->flags & DEV_FLAG_HS_TIMING)) return SDMMC_ERR_NOT_SUPPORTED;
+		TMIO_setClock(&dev->port, HS_CLOCK);
+		dev->flags |= DEV_FLAG_HS;
+	}
+	else
+	{
+		TMIO_setClock(&dev->port, DEFAULT_CLOCK);
+		dev->flags &= ~DEV_FLAG_HS;
+	}
 
 	return SDMMC_ERR_NONE;
 }
@@ -513,7 +998,9 @@ u32 SDMMC_setSleepMode(const u8 devNum, const bool enabled)
 u32 SDMMC_deinit(const u8 devNum)
 {
 	if(devNum > SDMMC_MAX_DEV_NUM) return SDMMC_ERR_INVAL_PARAM;
+	drainQueue(devNum);
 
+	if(g_devs[devNum].flags & DEV_FLAG_SLEEP) accountSleep(devNum);
 	memset(&g_devs[devNum], 0, sizeof(SdmmcDev));
 
 	return SDMMC_ERR_NONE;
@@ -523,13 +1010,16 @@ u32 SDMMC_lockUnlock(const u8 devNum, const u8 mode, const u8 *const pwd, const
 {
 	// Password length is maximum 16 bytes except when replacing a password.
 	if(devNum > SDMMC_MAX_DEV_NUM || pwdLen > 32) return SDMMC_ERR_INVAL_PARAM;
+	drainQueue(devNum);
+	u32 res = wakeForAccess(devNum);
+	if(res != SDMMC_ERR_NONE) return res;
 
 	// Set block length on (e)MMC/SD side and host.
 	// Same CMD for (e)MMC/SD.
 	SdmmcDev *const dev = &g_devs[devNum];
 	TmioPort *const port = &dev->port;
 	const u32 blockLen = (mode != SDMMC_LK_ERASE ? 2 + pwdLen : 1);
-	u32 res = TMIO_sendCommand(port, MMC_SET_BLOCKLEN, blockLen);
+	res = TMIO_sendCommand(port, MMC_SET_BLOCKLEN, blockLen);
 	if(res != 0) return SDMMC_ERR_SET_BLOCKLEN;
 	TMIO_setBlockLen(port, blockLen);
 
@@ -609,13 +1099,38 @@ u32 SDMMC_importDevState(const u8 devNum, const u8 devIn[64])
 	if(dev->type != DEV_TYPE_NONE) return SDMMC_ERR_INITIALIZED;
 
 	memcpy(dev, devIn, 64);
+	if(devNum == SDMMC_DEV_CARD) g_cardChanges = TMIO_getCardChanges();
 
 	// Update write protection slider state just in case.
 	dev->prot |= !TMIO_cardWritable();
+	g_idle[devNum].lastActive = getIdleTicks();
+	updateIdleClock();
 
 	return SDMMC_ERR_NONE;
 }
 
+u32 SDMMC_verifyDevState(const u8 devNum)
+{
+	if(devNum > SDMMC_MAX_DEV_NUM) return SDMMC_ERR_INVAL_PARAM;
+
+	SdmmcDev *const dev = &g_devs[devNum];
+	if(dev->type == DEV_TYPE_NONE) return SDMMC_ERR_NO_CARD;
+	drainQueue(devNum);
+
+	// A swapped or power cycled card won't answer to the old RCA.
+	u32 res = (cardChanged(devNum) ? SDMMC_ERR_NO_CARD : wakeForAccess(devNum));
+	if(res == SDMMC_ERR_NONE)
+	{
+		if(updateStatus(dev, false) != 0) res = SDMMC_ERR_SEND_STATUS;
+		else if((dev->status & MMC_R1_STATE_MASK) != MMC_R1_STATE_TRAN) res = SDMMC_ERR_CARD_STATUS;
+	}
+
+	if(res != SDMMC_ERR_NONE) memset(dev, 0, sizeof(SdmmcDev));
+	else                      dev->status = 0;
+
+	return res;
+}
+
 #ifdef __ARM9__
 typedef struct
 {
@@ -665,6 +1180,9 @@ u32 SDMMC_importHosEmmcState(void)
 	port->sd_option   = (ctx->sd_option & 0xFF00u) | OPTION_DEFAULT_TIMINGS; // Use our own timings.
 	// Remaining fields don't matter.
 
+	// Clock divider 2 is only used in high speed mode.
+	if((ctx->sd_clk_ctrl & 0xFFu) == SD_CLK_DIV_2) dev->flags |= DEV_FLAG_HS_TIMING | DEV_FLAG_HS;
+
 	u8 devType;
 	if(ctx->isMmc && !ctx->isSd)
 	{
@@ -699,6 +1217,7 @@ u32 SDMMC_importHosEmmcState(void)
 	dev->rca     = ctx->rca;
 	dev->ccc     = extractBits(csd, 84, 12); // [95:84]
 	dev->sectors = ctx->sectors;
+	if(sdEraseSectorOnly(csd, devType)) dev->flags |= DEV_FLAG_ERASE_SECT;
 
 	// CID is in TMIO response format.
 	u32 *const dstCid = dev->cid;
@@ -732,6 +1251,12 @@ u32 SDMMC_getDevInfo(const u8 devNum, SdmmcInfo *const infoOut)
 	infoOut->ccc      = dev->ccc;
 	infoOut->busWidth = (port->sd_option & OPTION_BUS_WIDTH1 ? 1 : 4);
 
+	// AU_SIZE 1-9 are 16 KiB to 4 MiB in powers of 2. The rest is SDXC only.
+	static const u32 auSizes[16] = {0, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192,
+	                                16384, 24576, 32768, 49152, 65536, 131072};
+	infoOut->auSize   = auSizes[dev->auSize];
+	infoOut->busMode  = (dev->flags & DEV_FLAG_HS ? SDMMC_BUS_MODE_HS : SDMMC_BUS_MODE_DEFAULT);
+
 	return SDMMC_ERR_NONE;
 }
 
@@ -753,6 +1278,8 @@ u8 SDMMC_getDiskStatus(const u8 devNum)
 	u8 status = 0;
 	if(devNum == SDMMC_DEV_CARD)
 		status = (TMIO_cardDetected() == true ? 0 : STA_NODISK | STA_NOINIT);
+	if(cardChanged(devNum))
+		status |= STA_NOINIT;
 
 	const SdmmcDev *const dev = &g_devs[devNum];
 	status |= (dev->prot != 0 ? STA_PROTECT : 0);
@@ -773,20 +1300,6 @@ u32 SDMMC_getSectors(const u8 devNum)
 	return g_devs[devNum].sectors;
 }
 
-static u32 updateStatus(SdmmcDev *const dev, const bool stopTransmission)
-{
-	TmioPort *const port = &dev->port;
-
-	// MMC_STOP_TRANSMISSION: Same CMD for (e)MMC/SD. Relies on the driver returning a proper response.
-	// MMC_SEND_STATUS:       Same CMD for (e)MMC/SD but the argument format differs slightly.
-	u32 res;
-	if(stopTransmission) res = TMIO_sendCommand(port, MMC_STOP_TRANSMISSION, 0);
-	else                 res = TMIO_sendCommand(port, MMC_SEND_STATUS, (u32)dev->rca<<16);
-	dev->status = (res == 0 ? port->resp[0] : 0); // Don't update the status with stale data.
-
-	return res;
-}
-
 // Note: On multi-block read from the last 2 sectors there are no errors reported by the controller
 //       however the R1 card status may report ADDRESS_OUT_OF_RANGE on next(?) status read.
 //       This error is normal for (e)MMC and can be ignored.
@@ -797,7 +1310,10 @@ u32 SDMMC_readSectors(const u8 devNum, u32 sect, void *const buf, const u16 coun
 	// Check if the device is initialized.
 	SdmmcDev *const dev = &g_devs[devNum];
 	const u8 devType = dev->type;
-	if(devType == DEV_TYPE_NONE) return SDMMC_ERR_NO_CARD;
+	if(devType == DEV_TYPE_NONE || cardChanged(devNum)) return SDMMC_ERR_NO_CARD;
+	drainQueue(devNum);
+	u32 res = wakeForAccess(devNum);
+	if(res != SDMMC_ERR_NONE) return res;
 
 	// Set destination buffer and sector count.
 	TmioPort *const port = &dev->port;
@@ -807,7 +1323,8 @@ u32 SDMMC_readSectors(const u8 devNum, u32 sect, void *const buf, const u16 coun
 	// Read multiple 512 bytes blocks. Same CMD for (e)MMC/SD.
 	const u16 readCmd = (count == 1 ? MMC_READ_SINGLE_BLOCK : MMC_READ_MULTIPLE_BLOCK);
 	if(devType == DEV_TYPE_MMC || devType == DEV_TYPE_SDSC) sect *= 512; // Byte addressing.
-	u32 res = TMIO_sendCommand(port, readCmd, sect);
+	const u32 startTicks = TMIO_getStatsTicks();
+	res = TMIO_sendCommand(port, readCmd, sect);
 	if(res != 0)
 	{
 		// On error in the middle of multi-block reads the card will be stuck
@@ -816,10 +1333,18 @@ u32 SDMMC_readSectors(const u8 devNum, u32 sect, void *const buf, const u16 coun
 		// Otherwise for single-block reads just update the status.
 		updateStatus(dev, count > 1);
 
-		return SDMMC_ERR_SECT_RW;
+		// DMA transfers can't be restarted from here. The caller has to retry.
+		if(crcFallback(dev, res) && buf != NULL)
+		{
+			countRetry(devNum);
+			TMIO_setBuffer(port, buf, count);
+			res = TMIO_sendCommand(port, readCmd, sect);
+			if(res != 0) updateStatus(dev, count > 1);
+		}
 	}
+	recordTransfer(devNum, SDMMC_REQ_READ, count, startTicks, res);
 
-	return SDMMC_ERR_NONE;
+	return (res == 0 ? SDMMC_ERR_NONE : SDMMC_ERR_SECT_RW);
 }
 
 // Note: On multi-block write to the last 2 sectors there are no errors reported by the controller
@@ -832,10 +1357,13 @@ u32 SDMMC_writeSectors(const u8 devNum, u32 sect, const void *const buf, const u
 	// Check if the device is initialized.
 	SdmmcDev *const dev = &g_devs[devNum];
 	const u8 devType = dev->type;
-	if(devType == DEV_TYPE_NONE) return SDMMC_ERR_NO_CARD;
+	if(devType == DEV_TYPE_NONE || cardChanged(devNum)) return SDMMC_ERR_NO_CARD;
 
 	// Check if the device is write protected.
 	if(dev->prot != 0) return SDMMC_ERR_WRITE_PROT;
+	drainQueue(devNum);
+	u32 res = wakeForAccess(devNum);
+	if(res != SDMMC_ERR_NONE) return res;
 
 	// Set source buffer and sector count.
 	TmioPort *const port = &dev->port;
@@ -845,7 +1373,8 @@ u32 SDMMC_writeSectors(const u8 devNum, u32 sect, const void *const buf, const u
 	// Write multiple 512 bytes blocks. Same CMD for (e)MMC/SD.
 	const u16 writeCmd = (count == 1 ? MMC_WRITE_BLOCK : MMC_WRITE_MULTIPLE_BLOCK);
 	if(devType == DEV_TYPE_MMC || devType == DEV_TYPE_SDSC) sect *= 512; // Byte addressing.
-	const u32 res = TMIO_sendCommand(port, writeCmd, sect);
+	const u32 startTicks = TMIO_getStatsTicks();
+	res = TMIO_sendCommand(port, writeCmd, sect);
 	if(res != 0)
 	{
 		// On error in the middle of multi-block writes the card will be stuck
@@ -854,16 +1383,27 @@ u32 SDMMC_writeSectors(const u8 devNum, u32 sect, const void *const buf, const u
 		// Otherwise for single-block writes just update the status.
 		updateStatus(dev, count > 1);
 
-		return SDMMC_ERR_SECT_RW;
+		// DMA transfers can't be restarted from here. The caller has to retry.
+		if(crcFallback(dev, res) && buf != NULL)
+		{
+			countRetry(devNum);
+			TMIO_setBuffer(port, (void*)buf, count);
+			res = TMIO_sendCommand(port, writeCmd, sect);
+			if(res != 0) updateStatus(dev, count > 1);
+		}
 	}
+	recordTransfer(devNum, SDMMC_REQ_WRITE, count, startTicks, res);
 
-	return SDMMC_ERR_NONE;
+	return (res == 0 ? SDMMC_ERR_NONE : SDMMC_ERR_SECT_RW);
 }
 
 u32 SDMMC_sendCommand(const u8 devNum, MmcCommand *const mmcCmd)
 {
 	if(devNum > SDMMC_MAX_DEV_NUM) return SDMMC_ERR_INVAL_PARAM;
 
+	drainQueue(devNum);
+	if(wakeForAccess(devNum) != SDMMC_ERR_NONE) return SDMMC_ERR_SEND_CMD;
+
 	SdmmcDev *const dev = &g_devs[devNum];
 	TmioPort *const port = &dev->port;
 	TMIO_setBlockLen(port, mmcCmd->blkLen);
@@ -882,6 +1422,163 @@ u32 SDMMC_sendCommand(const u8 devNum, MmcCommand *const mmcCmd)
 	return SDMMC_ERR_NONE;
 }
 
+u32 SDMMC_submitRequest(const u8 devNum, SdmmcReq *const req)
+{
+	if(devNum > SDMMC_MAX_DEV_NUM || req->count == 0 || req->op > SDMMC_REQ_WRITE)
+		return SDMMC_ERR_INVAL_PARAM;
+
+	// Check if the device is initialized.
+	SdmmcDev *const dev = &g_devs[devNum];
+	if(dev->type == DEV_TYPE_NONE || cardChanged(devNum)) return SDMMC_ERR_NO_CARD;
+
+	// Check if the device is write protected.
+	if(req->op == SDMMC_REQ_WRITE && dev->prot != 0) return SDMMC_ERR_WRITE_PROT;
+
+	req->next   = NULL;
+	req->devNum = devNum;
+	req->res    = SDMMC_ERR_NONE;
+	g_idle[devNum].lastActive = getIdleTicks();
+	atomic_store_explicit(&req->done, false, memory_order_relaxed);
+#ifdef __ARM11__
+	if(req->event != 0) clearEvent(req->event);
+#endif // #ifdef __ARM11__
+
+	recoverQueue(devNum);
+
+	const u32 savedState = enterCriticalSection();
+	SdmmcQueue *const queue = getQueue(devNum);
+	SdmmcReq *const tail = queue->tail;
+	if(tail != NULL) tail->next = req;
+	else             queue->head = req;
+	queue->tail = req;
+
+	// Start right away if the queue was empty.
+	if(tail == NULL) startRequest(dev, req);
+	leaveCriticalSection(savedState);
+
+	return SDMMC_ERR_NONE;
+}
+
+bool SDMMC_pollRequest(SdmmcReq *const req)
+{
+	if(!atomic_load_explicit(&req->done, memory_order_acquire)) return false;
+
+	// Failed requests stall the queue until the card recovered.
+	recoverQueue(req->devNum);
+
+	return true;
+}
+
+u32 SDMMC_waitRequest(SdmmcReq *const req)
+{
+#ifdef __ARM11__
+	const KHandle event = req->event;
+#endif // #ifdef __ARM11__
+	while(!atomic_load_explicit(&req->done, memory_order_acquire))
+	{
+#ifdef __ARM11__
+		if(event != 0)
+		{
+			waitForEvent(event);
+			continue;
+		}
+#endif // #ifdef __ARM11__
+
+		// Check again with IRQs disabled to not miss the completion.
+		const u32 savedState = enterCriticalSection();
+		if(!atomic_load_explicit(&req->done, memory_order_relaxed)) __wfi();
+		leaveCriticalSection(savedState);
+	}
+
+	// Failed requests stall the queue until the card recovered.
+	recoverQueue(req->devNum);
+
+	return req->res;
+}
+
+// Waits for the card to leave the programming state after R1b commands.
+static u32 waitWhileBusy(SdmmcDev *const dev, u32 timeoutMs)
+{
+	TmioPort *const port = &dev->port;
+	const u32 errMask = (IS_DEV_MMC(dev->type) ? MMC_R1_ERR_ALL : SD_R1_ERR_ALL);
+	while(1)
+	{
+		// Same CMD for (e)MMC/SD but the argument format differs slightly.
+		const u32 res = TMIO_sendCommand(port, MMC_SEND_STATUS, (u32)dev->rca<<16);
+		if(res != 0) return SDMMC_ERR_SEND_STATUS;
+
+		const u32 status = port->resp[0];
+		if(status & errMask)
+		{
+			dev->status = status;
+			return SDMMC_ERR_CARD_STATUS;
+		}
+
+		// Same bits for (e)MMC/SD R1 card status.
+		if((status & MMC_R1_READY_FOR_DATA) && (status & MMC_R1_STATE_MASK) == MMC_R1_STATE_TRAN)
+			break;
+
+		if(timeoutMs-- == 0) return SDMMC_ERR_ERASE;
+		TIMER_sleepMs(1);
+	}
+
+	return SDMMC_ERR_NONE;
+}
+
+u32 SDMMC_eraseSectors(const u8 devNum, u32 sect, u32 count)
+{
+	if(devNum > SDMMC_MAX_DEV_NUM || count == 0) return SDMMC_ERR_INVAL_PARAM;
+
+	// Check if the device is initialized.
+	SdmmcDev *const dev = &g_devs[devNum];
+	const u8 devType = dev->type;
+	if(devType == DEV_TYPE_NONE || cardChanged(devNum)) return SDMMC_ERR_NO_CARD;
+
+	// Check if the device is write protected.
+	if(dev->prot != 0) return SDMMC_ERR_WRITE_PROT;
+
+	// Check the range.
+	const u32 sectors = dev->sectors;
+	if(sect >= sectors || count > sectors - sect) return SDMMC_ERR_INVAL_PARAM;
+
+	// Class 5 (erase) is required. Don't use (e)MMC erase without TRIM support
+	// or SDSC erase without ERASE_BLK_EN. Both work on whole erase groups/sectors
+	// and would destroy neighbouring data.
+	const bool isMmc = IS_DEV_MMC(devType);
+	if(!(dev->ccc & BIT(5)) || (isMmc && !(dev->flags & DEV_FLAG_TRIM)) || (dev->flags & DEV_FLAG_ERASE_SECT))
+		return SDMMC_ERR_NOT_SUPPORTED;
+
+	drainQueue(devNum);
+	u32 res = wakeForAccess(devNum);
+	if(res != SDMMC_ERR_NONE) return res;
+
+	TmioPort *const port = &dev->port;
+	const u16 startCmd = (isMmc ? MMC_ERASE_GROUP_START : SD_ERASE_WR_BLK_START);
+	const u16 endCmd   = (isMmc ? MMC_ERASE_GROUP_END : SD_ERASE_WR_BLK_END);
+	const u32 eraseArg = (isMmc ? 1 : 0); // (e)MMC: TRIM. SD: Erase.
+	const u32 addrShift = (devType == DEV_TYPE_MMC || devType == DEV_TYPE_SDSC ? 9 : 0); // Byte addressing.
+	do
+	{
+		const u32 chunk = (count > ERASE_MAX_SECTORS ? ERASE_MAX_SECTORS : count);
+		if(TMIO_sendCommand(port, startCmd, sect<<addrShift) != 0 ||
+		   TMIO_sendCommand(port, endCmd, (sect + chunk - 1)<<addrShift) != 0 ||
+		   TMIO_sendCommand(port, MMC_ERASE, eraseArg) != 0) // Same CMD for (e)MMC/SD.
+		{
+			updateStatus(dev, false);
+			res = SDMMC_ERR_ERASE;
+			break;
+		}
+
+		res = waitWhileBusy(dev, ERASE_TIMEOUT_MS);
+		if(res != SDMMC_ERR_NONE) break;
+
+		sect += chunk;
+		count -= chunk;
+	} while(count > 0);
+
+	return res;
+}
+
 u32 SDMMC_getLastR1error(const u8 devNum)
 {
 	if(devNum > SDMMC_MAX_DEV_NUM) return 0;
@@ -891,4 +1588,83 @@ u32 SDMMC_getLastR1error(const u8 devNum)
 	dev->status = 0;
 
 	return status;
+}
+
+u32 SDMMC_getStats(const u8 devNum, SdmmcStats *const statsOut)
+{
+	if(devNum > SDMMC_MAX_DEV_NUM) return SDMMC_ERR_INVAL_PARAM;
+
+#if TMIO_STATS
+	// Async requests update the statistics from the tmio ISR.
+	const u32 savedState = enterCriticalSection();
+	if(g_devs[devNum].flags & DEV_FLAG_SLEEP) accountSleep(devNum);
+	memcpy(statsOut, &g_stats[devNum], sizeof(SdmmcStats));
+	leaveCriticalSection(savedState);
+#else
+	memset(statsOut, 0, sizeof(SdmmcStats));
+#endif
+
+	return SDMMC_ERR_NONE;
+}
+
+u32 SDMMC_resetStats(const u8 devNum)
+{
+	if(devNum > SDMMC_MAX_DEV_NUM) return SDMMC_ERR_INVAL_PARAM;
+
+#if TMIO_STATS
+	const u32 savedState = enterCriticalSection();
+	memset(&g_stats[devNum], 0, sizeof(SdmmcStats));
+	g_idle[devNum].sleepStart = TMIO_getStatsTicks();
+	leaveCriticalSection(savedState);
+#endif
+
+	return SDMMC_ERR_NONE;
+}
+
+u32 SDMMC_setIdleTimeout(const u8 devNum, const u32 timeoutMs)
+{
+	if(devNum > SDMMC_MAX_DEV_NUM) return SDMMC_ERR_INVAL_PARAM;
+#ifdef __ARM11__
+	if(timeoutMs > IDLE_TIMEOUT_MAX_MS) return SDMMC_ERR_INVAL_PARAM;
+#endif // #ifdef __ARM11__
+
+	// Round up. The device sleeps once it was idle for longer than this.
+	SdmmcIdle *const idle = &g_idle[devNum];
+	idle->timeout = (u32)(((u64)timeoutMs * SDMMC_IDLE_TICK_FREQ + 999) / 1000);
+	updateIdleClock();
+	idle->lastActive = getIdleTicks();
+
+	return SDMMC_ERR_NONE;
+}
+
+#ifdef __ARM9__
+void SDMMC_setIdleHandler(SdmmcIdleHandler handler)
+{
+	g_idleHandler = handler;
+}
+#endif // #ifdef __ARM9__
+
+u32 SDMMC_pollIdle(const u8 devNum)
+{
+	if(devNum > SDMMC_MAX_DEV_NUM) return SDMMC_ERR_INVAL_PARAM;
+
+	// Check if the device is initialized.
+	SdmmcDev *const dev = &g_devs[devNum];
+	if(dev->type == DEV_TYPE_NONE || cardChanged(devNum)) return SDMMC_ERR_NO_CARD;
+
+	// Failed requests must be recovered before the card can sleep.
+	recoverQueue(devNum);
+
+	// The ISR may wake the device up or complete requests in the meantime.
+	SdmmcIdle *const idle = &g_idle[devNum];
+	const u32 savedState = enterCriticalSection();
+	const bool asleep = (dev->flags & DEV_FLAG_SLEEP) != 0;
+	if(asleep) accountSleep(devNum); // Don't let the timestamp wrap around.
+	const bool idleLongEnough = getQueue(devNum)->head == NULL && idle->timeout != 0 &&
+	                            getIdleTicks() - idle->lastActive > idle->timeout;
+	leaveCriticalSection(savedState);
+
+	if(asleep || !idleLongEnough) return SDMMC_ERR_NONE;
+
+	return SDMMC_setSleepMode(devNum, true);
 }
\ No newline at end of file
@@ -16,12 +16,16 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
 #include "types.h"
 #include "drivers/pxi.h"
 #ifdef __ARM9__
 #include "arm9/drivers/interrupt.h"
 #elif __ARM11__
 #include "arm11/drivers/interrupt.h"
+#include "kevent.h"
+#include "kmutex.h"
+#include "kworkqueue.h"
 #endif // #ifdef __ARM9__
 #include "debug.h"
 #include "ipc_handler.h"
@@ -30,10 +34,37 @@
 
 
 static vu32 g_lastResp[2] = {0};
+#ifdef __ARM9__
+// Commands can't wait in the IRQ handler for a lock held by the code they
+// interrupted. The ARM11 has only one command in flight so one slot is enough.
+static struct
+{
+	bool defer;
+	bool pending;
+	u32 cmdCode;
+	u32 buf[IPC_MAX_PARAMS];
+} g_deferred = {0};
+#elif __ARM11__
+// Any task may send commands but only one can be in flight at a time.
+static KHandle g_sendMutex = 0;
+static KHandle g_respEvent = 0;
+// Commands from the ARM9 run on a work queue instead of the IRQ handler.
+// The ARM9 waits for the response so one slot is enough.
+static KHandle g_cmdQueue = 0;
+static KWork g_cmdWork;
+static struct
+{
+	u32 cmdCode;
+	u32 buf[IPC_MAX_PARAMS];
+} g_queuedCmd;
+#endif // #ifdef __ARM9__
 
 
 
 static void pxiIrqHandler(UNUSED u32 id);
+#ifdef __ARM11__
+static void queuedCmdWork(UNUSED void *arg);
+#endif
 
 static inline void sendWord(Pxi *const pxi, u32 word)
 {
@@ -70,6 +101,12 @@ void PXI_init(void)
 
 	IRQ_registerIsr(IRQ_PXI_SYNC, pxiIrqHandler);
 #elif __ARM11__
+	g_sendMutex = createMutex();
+	g_respEvent = createEvent(false);
+	g_cmdQueue  = createWorkQueue(0x1000, 3);
+	if(g_sendMutex == 0 || g_respEvent == 0 || g_cmdQueue == 0) panic();
+	initWork(&g_cmdWork, queuedCmdWork, NULL);
+
 	while(recvWord(pxi) != 0x99);
 	sendWord(pxi, 0x11);
 
@@ -84,6 +121,15 @@ void PXI_deinit(void)
 	pxi->sync = 0;
 }
 
+static void handleCmd(Pxi *const pxi, const u32 cmdCode, const u32 *const buf)
+{
+	const u32 res = IPC_handleCmd(IPC_CMD_ID_MASK(cmdCode), IPC_CMD_SEND_BUFS_MASK(cmdCode),
+	                              IPC_CMD_RECV_BUFS_MASK(cmdCode), buf);
+	sendWord(pxi, IPC_CMD_RESP_FLAG | cmdCode);
+	sendWord(pxi, res);
+	sendSyncRequest(pxi);
+}
+
 static void pxiIrqHandler(UNUSED u32 id)
 {
 	Pxi *const pxi = getPxiRegs();
@@ -92,6 +138,9 @@ static void pxiIrqHandler(UNUSED u32 id)
 	{
 		g_lastResp[0] = cmdCode;
 		g_lastResp[1] = recvWord(pxi);
+#ifdef __ARM11__
+		signalEvent(g_respEvent, false);
+#endif
 		return;
 	}
 
@@ -105,12 +154,43 @@ static void pxiIrqHandler(UNUSED u32 id)
 	for(u32 i = 0; i < words; i++) buf[i] = recvWord(pxi);
 	if(getFifoError(pxi)) panic();
 
-	const u32 res = IPC_handleCmd(IPC_CMD_ID_MASK(cmdCode), sendBufs, recvBufs, buf);
-	sendWord(pxi, IPC_CMD_RESP_FLAG | cmdCode);
-	sendWord(pxi, res);
-	sendSyncRequest(pxi);
+#ifdef __ARM9__
+	if(g_deferred.defer)
+	{
+		g_deferred.cmdCode = cmdCode;
+		memcpy(g_deferred.buf, buf, words * 4);
+		g_deferred.pending = true;
+		return;
+	}
+
+	handleCmd(pxi, cmdCode, buf);
+#elif __ARM11__
+	// Fails if the ARM9 sent another command before we responded.
+	g_queuedCmd.cmdCode = cmdCode;
+	memcpy(g_queuedCmd.buf, buf, words * 4);
+	if(!queueWork(g_cmdQueue, &g_cmdWork)) panic();
+#endif // #ifdef __ARM9__
 }
 
+#ifdef __ARM9__
+void PXI_setDeferCmds(const bool defer)
+{
+	const u32 savedState = enterCriticalSection();
+	g_deferred.defer = defer;
+	const bool run = !defer && g_deferred.pending;
+	g_deferred.pending = false;
+	leaveCriticalSection(savedState);
+
+	// Nothing else arrives until we respond.
+	if(run) handleCmd(getPxiRegs(), g_deferred.cmdCode, g_deferred.buf);
+}
+#elif __ARM11__
+static void queuedCmdWork(UNUSED void *arg)
+{
+	handleCmd(getPxiRegs(), g_queuedCmd.cmdCode, g_queuedCmd.buf);
+}
+#endif // #ifdef __ARM9__
+
 u32 PXI_sendCmd(u32 cmd, const u32 *buf, u32 words)
 {
 	fb_assert(words <= IPC_MAX_PARAMS);
@@ -132,6 +212,11 @@ u32 PXI_sendCmd(u32 cmd, const u32 *buf, u32 words)
 		if(recvBuf->ptr && recvBuf->size) flushDCacheRange(recvBuf->ptr, recvBuf->size);
 	}
 
+#ifdef __ARM11__
+	lockMutex(g_sendMutex);
+	clearEvent(g_respEvent);
+#endif
+
 	Pxi *const pxi = getPxiRegs();
 	sendWord(pxi, cmd);
 	sendSyncRequest(pxi);
@@ -139,10 +224,19 @@ u32 PXI_sendCmd(u32 cmd, const u32 *buf, u32 words)
 	for(u32 i = 0; i < words; i++) sendWord(pxi, buf[i]);
 	if(getFifoError(pxi)) panic();
 
+#ifdef __ARM11__
+	// Other tasks keep running while the ARM9 works on the command.
+	while(g_lastResp[0] != (IPC_CMD_RESP_FLAG | cmd)) waitForEvent(g_respEvent);
+#else
 	while(g_lastResp[0] != (IPC_CMD_RESP_FLAG | cmd)) __wfi();
+#endif
 	g_lastResp[0] = 0;
 	const u32 res = g_lastResp[1];
 
+#ifdef __ARM11__
+	unlockMutex(g_sendMutex);
+#endif
+
 #ifdef __ARM11__
 	// The CPU may do speculative prefetches of data after the first invalidation
 	// so we need to do it again.
@@ -16,13 +16,20 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
 #include "types.h"
 #include "drivers/tmio.h"
 #include "drivers/tmio_config.h"
 #ifdef __ARM9__
 #include "util.h" // wait_cycles()
+#include "arm9/drivers/timer.h"
 #elif __ARM11__
 #include "arm11/drivers/timer.h"
+#include "arm11/drivers/performance_monitor.h"
+#include "arm11/drivers/interrupt.h"
+#include "drivers/corelink_dma-330.h"
+#include "drivers/cache.h"
+#include "kevent.h"
 #endif // #ifdef __ARM9__
 
 
@@ -39,8 +46,48 @@
 #define INIT_DELAY_FUNC()  TIMER_sleepNs((1000000000ull * TMIO_clk2div(400000u) * 74) / TMIO_HCLK)
 #endif // #ifdef __ARM9__
 
+#if defined(__ARM11__) && TMIO_USE_CDMA
+// CDMA channel 0 and 1 are used by lgycap. The event number equals the channel.
+#define CDMA_CH          (2u)
+#define CDMA_PERIPH      (5u)  // Controller 2 (physical 3) FIFO burst request.
+#define CDMA_MIN_BLOCKS  (2u)  // Single blocks are faster with the CPU.
+#define CDMA_BLOCK_SIZE  (19u) // Size of the per block code in bytes.
+#endif
+
+
+typedef struct
+{
+	TmioPort *port;     // Port of the active async command. NULL if none.
+	TmioCallback cb;
+	u8 *buf;            // Current position in the data buffer. NULL means DMA.
+	u16 cmd;
+	u16 blockCount;     // Remaining blocks for CPU transfers. Always 0 for DMA.
+	bool gotResp;
+	u32 startTicks;     // Statistics timestamp of the command start.
+} TmioAsyncCmd;
 
 static au32 g_status[2] = {0};
+static TmioAsyncCmd g_async[2] = {0};
+#if TMIO_STATS
+static TmioStats g_stats[2] = {0};
+#endif
+
+static au32 g_cardChanges = 0;
+static TmioCardCallback g_cardCb = NULL;
+#ifdef __ARM11__
+static KHandle g_cardEvent = 0;
+#endif
+
+#if defined(__ARM11__) && TMIO_USE_CDMA
+static struct
+{
+	KHandle event; // 0 = CDMA not available.
+	bool active;   // A CDMA transfer is running.
+} g_cdma = {0};
+
+// Generated per transfer. Worst case is 74 bytes.
+alignas(32) static u8 g_cdmaProg[96];
+#endif
 
 
 
@@ -49,17 +96,77 @@ ALWAYS_INLINE u8 port2Controller(const u8 portNum)
 	return portNum / 2;
 }
 
+static void serviceAsyncCmd(Tmio *const regs, TmioAsyncCmd *const async, const u32 status);
+
+static void recordCommand(const TmioPort *const port, const u16 cmd, const u32 startTicks, const u32 res)
+{
+#if TMIO_STATS
+	TmioStats *const stats = &g_stats[port2Controller(port->portNum)];
+	const u32 idx = cmd & (CMD_ACMD | 0x3Fu);
+	stats->cmdCount[idx]++;
+	if(res != 0) stats->cmdErrors[idx]++;
+	else if(cmd & CMD_DATA_EN)
+	{
+		const u32 bytes = (u32)port->blocks * port->sd_blocklen;
+		if(cmd & CMD_DATA_R) stats->bytesRead += bytes;
+		else                 stats->bytesWritten += bytes;
+	}
+	stats->latencyHist[TMIO_statsBucket(TMIO_getStatsTicks() - startTicks)]++;
+#else
+	(void)port;
+	(void)cmd;
+	(void)startTicks;
+	(void)res;
+#endif
+}
+
 static void tmioIsr(const u32 id)
 {
 	const u8 controller = (id == TMIO_IRQ_ID_CONTROLLER1 ? 0 : 1);
 	Tmio *const regs = getTmioRegs(controller);
 
-	SET_STATUS(&g_status[controller], GET_STATUS(&g_status[controller]) | regs->sd_status);
+	const u32 status = GET_STATUS(&g_status[controller]) | regs->sd_status;
+	SET_STATUS(&g_status[controller], status);
 	regs->sd_status = STATUS_CMD_BUSY; // Never acknowledge STATUS_CMD_BUSY.
 
-	// TODO: Some kind of event to notify the main loop for remove/insert.
+	// Advance the async command state machine if there is one running.
+	TmioAsyncCmd *const async = &g_async[controller];
+	if(async->port != NULL) serviceAsyncCmd(regs, async, status);
+
+#if defined(__ARM11__) && TMIO_USE_CDMA
+	// On errors the CDMA would wait for burst requests forever.
+	if(controller == 1 && g_cdma.active && (status & STATUS_MASK_ERR))
+	{
+		g_cdma.active = false;
+		DMA330_kill(CDMA_CH);
+		signalEvent(g_cdma.event, false);
+	}
+#endif
+
+	// Card insert/remove. Only the ISR writes the counter.
+	if(controller == port2Controller(TMIO_CARD_PORT) && (status & (STATUS_INSERT | STATUS_REMOVE)))
+	{
+		const u32 changes = atomic_load_explicit(&g_cardChanges, memory_order_relaxed);
+		atomic_store_explicit(&g_cardChanges, changes + 1, memory_order_relaxed);
+
+		if(g_cardCb != NULL) g_cardCb((regs->sd_status & STATUS_DETECT) != 0);
+#ifdef __ARM11__
+		if(g_cardEvent != 0) signalEvent(g_cardEvent, false);
+#endif
+	}
 }
 
+#if defined(__ARM11__) && TMIO_USE_CDMA
+static void cdmaIsr(const u32 id)
+{
+	(void)id;
+
+	DMA330_ackIrq(CDMA_CH);
+	g_cdma.active = false;
+	signalEvent(g_cdma.event, false);
+}
+#endif
+
 void TMIO_init(void)
 {
 	// Do controller and port mapping (see tmio_config.h).
@@ -100,6 +207,30 @@ void TMIO_init(void)
 		regs->sdio_status_mask = SDIO_STATUS_MASK_ALL;
 		regs->ext_sdio_irq     = EXT_SDIO_IRQ_MASK_ALL;
 	}
+
+#if TMIO_STATS
+	// Free running statistics timestamp.
+#ifdef __ARM9__
+	TIMER_start(1, 0, TIMER_COUNT_UP);
+	TIMER_start(0, 0, TIMER_PRESC_64);
+#elif __ARM11__
+	// Timestamps assume divider 64. Force it even if someone else enabled the monitor.
+	perfMonitorCcntDiv64();
+#endif // #ifdef __ARM9__
+#endif // #if TMIO_STATS
+
+#if defined(__ARM11__) && TMIO_USE_CDMA
+	// Without the event all transfers fall back to the CPU.
+	if(TMIO_NUM_CONTROLLERS == 2u && g_cdma.event == 0)
+	{
+		const KHandle event = createEvent(true);
+		if(event != 0)
+		{
+			IRQ_registerIsr(IRQ_CDMA_EVENT0 + CDMA_CH, 14, 0, cdmaIsr);
+			g_cdma.event = event;
+		}
+	}
+#endif
 }
 
 void TMIO_deinit(void)
@@ -107,6 +238,17 @@ void TMIO_deinit(void)
 	// Unregister ISR and disable IRQs.
 	TMIO_UNREGISTER_ISR();
 
+#if defined(__ARM11__) && TMIO_USE_CDMA
+	if(g_cdma.event != 0)
+	{
+		DMA330_kill(CDMA_CH);
+		IRQ_unregisterIsr(IRQ_CDMA_EVENT0 + CDMA_CH);
+		deleteEvent(g_cdma.event);
+		g_cdma.event  = 0;
+		g_cdma.active = false;
+	}
+#endif
+
 	// Mask all IRQs.
 	for(u32 i = 0; i < TMIO_NUM_CONTROLLERS; i++)
 	{
@@ -121,6 +263,11 @@ void TMIO_deinit(void)
 		regs->sdio_status_mask = SDIO_STATUS_MASK_ALL;
 	}
 
+#if TMIO_STATS && defined(__ARM9__)
+	TIMER_stop(0);
+	TIMER_stop(1);
+#endif
+
 	// Reset controller and port mapping (see tmio_config.h).
 	TMIO_UNMAP_CONTROLLERS();
 }
@@ -152,6 +299,27 @@ bool TMIO_cardDetected(void)
 	return !!(getTmioRegs(port2Controller(TMIO_CARD_PORT))->sd_status & STATUS_DETECT);
 }
 
+u32 TMIO_getCardChanges(void)
+{
+	return atomic_load_explicit(&g_cardChanges, memory_order_relaxed);
+}
+
+void TMIO_setCardCallback(TmioCardCallback cb)
+{
+	const u32 savedState = enterCriticalSection();
+	g_cardCb = cb;
+	leaveCriticalSection(savedState);
+}
+
+#ifdef __ARM11__
+void TMIO_bindCardEvent(const KHandle event)
+{
+	const u32 savedState = enterCriticalSection();
+	g_cardEvent = event;
+	leaveCriticalSection(savedState);
+}
+#endif
+
 bool TMIO_cardWritable(void)
 {
 	return !!(getTmioRegs(port2Controller(TMIO_CARD_PORT))->sd_status & STATUS_NO_WRPROT);
@@ -183,13 +351,120 @@ static void getResponse(const Tmio *const regs, TmioPort *const port, const u16
 	}
 }
 
+static u8* readFifoBlockUnaligned(vu32 *const fifo, u8 *buf, const u32 blockLen)
+{
+	const u32 words = (blockLen + 3) / 4;
+#ifdef __ARM11__
+	// ARM11 supports unaligned access for single loads/stores.
+	for(u32 i = 0; i < words; i++)
+	{
+		*((u32*)buf) = *fifo;
+		buf += 4;
+	}
+#else
+	// Merge FIFO words with shifts so only the first and last bytes need byte stores.
+	const u32 headBytes = 4 - (uintptr_t)buf % 4;
+	const u32 rShift = headBytes * 8;
+	const u32 lShift = 32 - rShift;
+	u32 cur = *fifo;
+	for(u32 i = 0; i < headBytes; i++) *buf++ = cur>>(i * 8);
+
+	u32 *buf32 = (u32*)buf;
+	for(u32 i = 1; i < words; i++)
+	{
+		const u32 next = *fifo;
+		*buf32++ = cur>>rShift | next<<lShift;
+		cur = next;
+	}
+
+	buf = (u8*)buf32;
+	cur >>= rShift;
+	for(u32 i = headBytes; i < 4; i++)
+	{
+		*buf++ = cur;
+		cur >>= 8;
+	}
+#endif // #ifdef __ARM11__
+
+	return buf;
+}
+
+// The FIFO side has a fixed address but the buffer side is
+// done 8 words at a time which compiles to ldm/stm bursts.
+static u8* readFifoBlock(vu32 *const fifo, u8 *buf, const u32 blockLen)
+{
+	if((uintptr_t)buf % 4 != 0) return readFifoBlockUnaligned(fifo, buf, blockLen);
+
+	u32 *buf32 = (u32*)buf;
+	u32 words = (blockLen + 3) / 4;
+	for(; words >= 8; words -= 8)
+	{
+		const u32 w0 = *fifo, w1 = *fifo, w2 = *fifo, w3 = *fifo;
+		const u32 w4 = *fifo, w5 = *fifo, w6 = *fifo, w7 = *fifo;
+		buf32[0] = w0; buf32[1] = w1; buf32[2] = w2; buf32[3] = w3;
+		buf32[4] = w4; buf32[5] = w5; buf32[6] = w6; buf32[7] = w7;
+		buf32 += 8;
+	}
+	for(; words > 0; words--) *buf32++ = *fifo;
+
+	return (u8*)buf32;
+}
+
+static const u8* writeFifoBlockUnaligned(vu32 *const fifo, const u8 *buf, const u32 blockLen)
+{
+	const u32 words = (blockLen + 3) / 4;
+#ifdef __ARM11__
+	// ARM11 supports unaligned access for single loads/stores.
+	for(u32 i = 0; i < words; i++)
+	{
+		*fifo = *((const u32*)buf);
+		buf += 4;
+	}
+
+	return buf;
+#else
+	// Load aligned words and merge them with shifts. The first and last load
+	// may touch bytes outside the buffer but never outside its aligned words.
+	const u32 rShift = ((uintptr_t)buf % 4) * 8;
+	const u32 lShift = 32 - rShift;
+	const u32 *buf32 = (const u32*)((uintptr_t)buf & ~3u);
+	u32 cur = *buf32++;
+	for(u32 i = 0; i < words; i++)
+	{
+		const u32 next = *buf32++;
+		*fifo = cur>>rShift | next<<lShift;
+		cur = next;
+	}
+
+	return buf + words * 4;
+#endif // #ifdef __ARM11__
+}
+
+static const u8* writeFifoBlock(vu32 *const fifo, const u8 *buf, const u32 blockLen)
+{
+	if((uintptr_t)buf % 4 != 0) return writeFifoBlockUnaligned(fifo, buf, blockLen);
+
+	const u32 *buf32 = (const u32*)buf;
+	u32 words = (blockLen + 3) / 4;
+	for(; words >= 8; words -= 8)
+	{
+		const u32 w0 = buf32[0], w1 = buf32[1], w2 = buf32[2], w3 = buf32[3];
+		const u32 w4 = buf32[4], w5 = buf32[5], w6 = buf32[6], w7 = buf32[7];
+		*fifo = w0; *fifo = w1; *fifo = w2; *fifo = w3;
+		*fifo = w4; *fifo = w5; *fifo = w6; *fifo = w7;
+		buf32 += 8;
+	}
+	for(; words > 0; words--) *fifo = *buf32++;
+
+	return (const u8*)buf32;
+}
+
 // Note: Using STATUS_DATA_END to detect transfer end doesn't work reliably
 //       because STATUS_DATA_END fires before we even read anything from FIFO
 //       on single block read transfer.
-static void doCpuTransfer(Tmio *const regs, const u16 cmd, u8 *buf, const au32 *const statusPtr)
+static void doCpuTransfer(Tmio *const regs, const u16 cmd, u8 *buf, u32 blockCount, const au32 *const statusPtr)
 {
 	const u32 blockLen = regs->sd_blocklen;
-	u32 blockCount     = regs->sd_blockcount;
 	vu32 *const fifo = getTmioFifo(regs);
 	if(cmd & CMD_DATA_R)
 	{
@@ -197,29 +472,7 @@ static void doCpuTransfer(Tmio *const regs, const u16 cmd, u8 *buf, const au32 *
 		{
 			if(regs->sd_fifo32_cnt & FIFO32_FULL) // RX ready.
 			{
-				const u8 *const blockEnd = buf + blockLen;
-				do
-				{
-#ifdef __ARM11__
-					// ARM11 supports unaligned access.
-					*((u32*)buf) = *fifo;
-#else
-					if((uintptr_t)buf % 4 == 0)
-					{
-						*((u32*)buf) = *fifo;
-					}
-					else
-					{
-						const u32 tmp = *fifo;
-						buf[0] = tmp;
-						buf[1] = tmp>>8;
-						buf[2] = tmp>>16;
-						buf[3] = tmp>>24;
-					}
-#endif // #ifdef __ARM11__
-					buf += 4;
-				} while(buf < blockEnd);
-
+				buf = readFifoBlock(fifo, buf, blockLen);
 				blockCount--;
 			}
 			else __wfi();
@@ -227,35 +480,12 @@ static void doCpuTransfer(Tmio *const regs, const u16 cmd, u8 *buf, const au32 *
 	}
 	else
 	{
-		// TODO: Write first block ahead of time?
-		// gbatek Command/Param/Response/Data at bottom of page.
+		// The first block was written ahead of time by startCommand().
 		while((GET_STATUS(statusPtr) & STATUS_MASK_ERR) == 0 && blockCount > 0)
 		{
 			if(!(regs->sd_fifo32_cnt & FIFO32_NOT_EMPTY)) // TX request.
 			{
-				const u8 *const blockEnd = buf + blockLen;
-				do
-				{
-#ifdef __ARM11__
-					// ARM11 supports unaligned access.
-					*fifo = *((u32*)buf);
-#else
-					if((uintptr_t)buf % 4 == 0)
-					{
-						*fifo = *((u32*)buf);
-					}
-					else
-					{
-						u32 tmp = buf[0];
-						tmp |= (u32)buf[1]<<8;
-						tmp |= (u32)buf[2]<<16;
-						tmp |= (u32)buf[3]<<24;
-						*fifo = tmp;
-					}
-#endif // #ifdef __ARM11__
-					buf += 4;
-				} while(buf < blockEnd);
-
+				buf = (u8*)writeFifoBlock(fifo, buf, blockLen);
 				blockCount--;
 			}
 			else __wfi();
@@ -263,27 +493,204 @@ static void doCpuTransfer(Tmio *const regs, const u16 cmd, u8 *buf, const au32 *
 	}
 }
 
-u32 TMIO_sendCommand(TmioPort *const port, const u16 cmd, const u32 arg)
+// Called from the tmio ISR for each status or FIFO IRQ while an async command is active.
+static void serviceAsyncCmd(Tmio *const regs, TmioAsyncCmd *const async, const u32 status)
 {
-	const u8 controller = port2Controller(port->portNum);
-	Tmio *const regs = getTmioRegs(controller);
+	// Response end comes first. On error response end still fires.
+	if((status & STATUS_RESP_END) == 0) return;
 
-	// Clear status before sending another command.
-	au32 *const statusPtr = &g_status[controller];
-	SET_STATUS(statusPtr, 0);
+	TmioPort *const port = async->port;
+	const u16 cmd = async->cmd;
+	if(!async->gotResp)
+	{
+		getResponse(regs, port, cmd);
+		async->gotResp = true;
+	}
+
+	if((cmd & CMD_DATA_EN) != 0)
+	{
+		// Move as many blocks as the FIFO currently allows.
+		u32 blockCount = async->blockCount;
+		if((status & STATUS_MASK_ERR) == 0 && blockCount > 0)
+		{
+			u8 *buf = async->buf;
+			const u32 blockLen = regs->sd_blocklen;
+			vu32 *const fifo = getTmioFifo(regs);
+			if(cmd & CMD_DATA_R)
+			{
+				while(blockCount > 0 && (regs->sd_fifo32_cnt & FIFO32_FULL)) // RX ready.
+				{
+					buf = readFifoBlock(fifo, buf, blockLen);
+					blockCount--;
+				}
+			}
+			else
+			{
+				while(blockCount > 0 && !(regs->sd_fifo32_cnt & FIFO32_NOT_EMPTY)) // TX request.
+				{
+					buf = (u8*)writeFifoBlock(fifo, buf, blockLen);
+					blockCount--;
+				}
+
+				// The FIFO stays empty after the last block. Stop TX request IRQs.
+				if(blockCount == 0) regs->sd_fifo32_cnt = FIFO32_EN;
+			}
+			async->buf        = buf;
+			async->blockCount = blockCount;
+
+			if(blockCount > 0) return;
+		}
+
+		// DMA transfers only wait for data end. On error data end still fires.
+		if((status & STATUS_DATA_END) == 0) return;
+	}
+
+	// Command finished. Mask FIFO IRQs and hand the result to the callback.
+	regs->sd_fifo32_cnt = FIFO32_CLEAR | FIFO32_EN;
+	async->port = NULL;
+	recordCommand(port, cmd, async->startTicks, status & STATUS_MASK_ERR);
+	async->cb(port, status & STATUS_MASK_ERR);
+}
+
+#if defined(__ARM11__) && TMIO_USE_CDMA
+static u8* cdmaEmitMov(u8 *p, const u8 reg, const u32 val)
+{
+	*p++ = 0xBC; // MOV
+	*p++ = reg;
+	memcpy(p, &val, 4);
+
+	return p + 4;
+}
+
+// One FIFO burst request per 512 bytes block moved in 8 bursts of 16 words.
+static u8* cdmaEmitBlock(u8 *p, const bool read)
+{
+	*p++ = 0x32; *p++ = CDMA_PERIPH<<3; // WFP CDMA_PERIPH, burst
+	for(u32 i = 0; i < 7; i++)
+	{
+		*p++ = 0x04;                    // LD
+		*p++ = 0x08;                    // ST
+	}
+	if(read)
+	{
+		*p++ = 0x27; *p++ = CDMA_PERIPH<<3; // LDPB CDMA_PERIPH
+		*p++ = 0x08;                        // ST
+	}
+	else
+	{
+		*p++ = 0x04;                        // LD
+		*p++ = 0x2B; *p++ = CDMA_PERIPH<<3; // STPB CDMA_PERIPH
+	}
+
+	return p;
+}
+
+static bool cdmaStart(Tmio *const regs, u8 *const buf, const u16 blocks, const bool read)
+{
+	u8 *p = g_cdmaProg;
+	const u32 ccr = 2u<<CCR_SRC_BURST_SIZE_SHIFT | 15u<<CCR_SRC_BURST_LEN_SHIFT | 2u<<CCR_SRC_PROT_CTRL_SHIFT |
+	                2u<<CCR_DST_BURST_SIZE_SHIFT | 15u<<CCR_DST_BURST_LEN_SHIFT | 2u<<CCR_DST_PROT_CTRL_SHIFT;
+	const u32 fifo = (u32)getTmioFifo(regs);
+	p = cdmaEmitMov(p, 1, ccr | (read ? CCR_DST_INC : CCR_SRC_INC)); // MOV CCR, SB16 SS32 DB16 DS32 SP2 DP2
+	p = cdmaEmitMov(p, 0, (read ? fifo : (u32)buf));                 // MOV SAR
+	p = cdmaEmitMov(p, 2, (read ? (u32)buf : fifo));                 // MOV DAR
+	*p++ = 0x35; *p++ = CDMA_PERIPH<<3;                              // FLUSHP CDMA_PERIPH
+
+	// Loop counters only go up to 256.
+	const u32 outer = blocks>>8;
+	if(outer > 0)
+	{
+		*p++ = 0x22; *p++ = outer - 1;              // LP1 outer
+		*p++ = 0x20; *p++ = 255;                    // LP0 256
+		p = cdmaEmitBlock(p, read);
+		*p++ = 0x38; *p++ = CDMA_BLOCK_SIZE;        // LPEND0
+		*p++ = 0x3C; *p++ = CDMA_BLOCK_SIZE + 4;    // LPEND1
+	}
+	const u32 rest = blocks & 0xFFu;
+	if(rest > 0)
+	{
+		*p++ = 0x20; *p++ = rest - 1;               // LP0 rest
+		p = cdmaEmitBlock(p, read);
+		*p++ = 0x38; *p++ = CDMA_BLOCK_SIZE;        // LPEND0
+	}
+	*p++ = 0x13;                                    // WMB
+	*p++ = 0x34; *p++ = CDMA_CH<<3;                 // SEV CDMA_CH
+	*p++ = 0x00;                                    // END
+
+	// Make sure the CDMA sees the program and no dirty lines get evicted over DMA data.
+	cleanDCacheRange(g_cdmaProg, sizeof(g_cdmaProg));
+	if(read) flushDCacheRange(buf, blocks * 512u);
+	else     cleanDCacheRange(buf, blocks * 512u);
+
+	clearEvent(g_cdma.event);
+	g_cdma.active = true;
+	if(DMA330_run(CDMA_CH, g_cdmaProg) != CSR_STAT_STOPPED)
+	{
+		g_cdma.active = false;
+		return false;
+	}
+
+	return true;
+}
+
+// CDMA is only wired up for controller 2 (physical 3). Buffers must be
+// cache line aligned because they get invalidated after reads.
+static bool cdmaUsable(const u8 controller, const TmioPort *const port, const u16 cmd)
+{
+	return controller == 1 && g_cdma.event != 0 && (cmd & CMD_DATA_EN) != 0 &&
+	       port->buf != NULL && (uintptr_t)port->buf % 32 == 0 &&
+	       port->sd_blocklen == 512 && port->blocks >= CDMA_MIN_BLOCKS;
+}
+#endif // #if defined(__ARM11__) && TMIO_USE_CDMA
 
+// Returns the number of blocks left for the CPU to transfer.
+// For CPU writes the first block is pushed into the FIFO before the command starts.
+static u16 startCommand(Tmio *const regs, const TmioPort *const port, const u16 cmd, const u32 arg, const bool cpuTransfer)
+{
 	setPort(regs, port);
 	const u16 blocks = port->blocks;
 	regs->sd_blockcount = blocks;         // sd_blockcount32 doesn't need to be set.
 	regs->sd_stop       = STOP_AUTO_STOP; // Auto STOP_TRANSMISSION (CMD12) on multi-block transfer.
 	regs->sd_arg        = arg;
 
-	// We don't need FIFO IRQs when using DMA. buf = NULL means DMA.
-	u8 *buf = port->buf;
+	// We don't need FIFO IRQs when using DMA.
+	const bool cpuWrite = cpuTransfer && (cmd & (CMD_DATA_EN | CMD_DATA_R)) == CMD_DATA_EN;
 	u16 f32Cnt = FIFO32_CLEAR | FIFO32_EN;
-	if(buf != NULL) f32Cnt |= (cmd & CMD_DATA_R ? FIFO32_FULL_IE : FIFO32_NOT_EMPTY_IE);
+	if(cpuTransfer && (cmd & CMD_DATA_R)) f32Cnt |= FIFO32_FULL_IE;
+	else if(cpuWrite && blocks > 1)       f32Cnt |= FIFO32_NOT_EMPTY_IE;
 	regs->sd_fifo32_cnt = f32Cnt;
-	regs->sd_cmd        = (blocks > 1 ? CMD_MULTI_DATA | cmd : cmd); // Start.
+
+	u16 blocksLeft = blocks;
+	if(cpuWrite)
+	{
+		writeFifoBlock(getTmioFifo(regs), port->buf, port->sd_blocklen);
+		blocksLeft--;
+	}
+
+	regs->sd_cmd = (blocks > 1 ? CMD_MULTI_DATA | cmd : cmd); // Start.
+
+	return blocksLeft;
+}
+
+u32 TMIO_sendCommand(TmioPort *const port, const u16 cmd, const u32 arg)
+{
+	const u8 controller = port2Controller(port->portNum);
+	Tmio *const regs = getTmioRegs(controller);
+
+	// Clear status before sending another command.
+	au32 *const statusPtr = &g_status[controller];
+	SET_STATUS(statusPtr, 0);
+	const u32 startTicks = TMIO_getStatsTicks();
+
+	// buf = NULL means DMA handled by the caller.
+	u8 *const buf = port->buf;
+#if defined(__ARM11__) && TMIO_USE_CDMA
+	const bool useCdma = cdmaUsable(controller, port, cmd) &&
+	                     cdmaStart(regs, buf, port->blocks, (cmd & CMD_DATA_R) != 0);
+#else
+	const bool useCdma = false;
+#endif
+	const u16 blocksLeft = startCommand(regs, port, cmd, arg, buf != NULL && !useCdma);
 
 	// TODO: Benchmark if this order is ideal?
 	// Response end comes immediately after the
@@ -295,7 +702,21 @@ u32 TMIO_sendCommand(TmioPort *const port, const u16 cmd, const u32 arg)
 	if((cmd & CMD_DATA_EN) != 0)
 	{
 		// If we have to transfer data do so now.
-		if(buf != NULL) doCpuTransfer(regs, cmd, buf, statusPtr);
+#if defined(__ARM11__) && TMIO_USE_CDMA
+		if(useCdma)
+		{
+			// Other tasks can run while the CDMA moves the data.
+			// The tmio ISR kills the CDMA and signals the event on errors.
+			waitForEvent(g_cdma.event);
+			if(cmd & CMD_DATA_R) invalidateDCacheRange(buf, port->blocks * 512u);
+		}
+		else
+#endif
+		if(buf != NULL)
+		{
+			const u32 prefilled = port->blocks - blocksLeft;
+			doCpuTransfer(regs, cmd, buf + prefilled * port->sd_blocklen, blocksLeft, statusPtr);
+		}
 
 		// Wait for data end if needed.
 		// On error data end still fires.
@@ -304,5 +725,82 @@ u32 TMIO_sendCommand(TmioPort *const port, const u16 cmd, const u32 arg)
 
 	// STATUS_CMD_BUSY is no longer set at this point.
 
-	return GET_STATUS(statusPtr) & STATUS_MASK_ERR;
+	const u32 res = GET_STATUS(statusPtr) & STATUS_MASK_ERR;
+	recordCommand(port, cmd, startTicks, res);
+
+	return res;
+}
+
+void TMIO_startCommand(TmioPort *const port, const u16 cmd, const u32 arg, TmioCallback cb)
+{
+	const u8 controller = port2Controller(port->portNum);
+	Tmio *const regs = getTmioRegs(controller);
+
+	// The ISR must not see the async state before the status is cleared.
+	const u32 savedState = enterCriticalSection();
+
+	TmioAsyncCmd *const async = &g_async[controller];
+	async->port       = port;
+	async->cb         = cb;
+	async->buf        = port->buf;
+	async->cmd        = cmd;
+	async->gotResp    = false;
+	async->startTicks = TMIO_getStatsTicks();
+
+	// Clear status before sending another command.
+	SET_STATUS(&g_status[controller], 0);
+	const u16 blocksLeft = startCommand(regs, port, cmd, arg, port->buf != NULL);
+
+	// With DMA the ISR must not touch the FIFO. It only waits for data end.
+	if(port->buf != NULL)
+	{
+		async->buf       += (port->blocks - blocksLeft) * port->sd_blocklen;
+		async->blockCount = blocksLeft;
+	}
+	else async->blockCount = 0;
+
+	leaveCriticalSection(savedState);
+}
+
+u32 TMIO_getStatsTicks(void)
+{
+#if !TMIO_STATS
+	return 0;
+#elif __ARM9__
+	// Timer 1 counts timer 0 overflows. Retry if timer 0 overflowed in between.
+	u16 hi, lo;
+	do
+	{
+		hi = TIMER_getTicks(1);
+		lo = TIMER_getTicks(0);
+	} while(hi != TIMER_getTicks(1));
+
+	return (u32)hi<<16 | lo;
+#elif __ARM11__
+	return __getCcnt();
+#endif
+}
+
+void TMIO_getStats(const u8 portNum, TmioStats *const statsOut)
+{
+#if TMIO_STATS
+	// Async commands update the statistics from the ISR.
+	const u32 savedState = enterCriticalSection();
+	memcpy(statsOut, &g_stats[port2Controller(portNum)], sizeof(TmioStats));
+	leaveCriticalSection(savedState);
+#else
+	(void)portNum;
+	memset(statsOut, 0, sizeof(TmioStats));
+#endif
+}
+
+void TMIO_resetStats(const u8 portNum)
+{
+#if TMIO_STATS
+	const u32 savedState = enterCriticalSection();
+	memset(&g_stats[port2Controller(portNum)], 0, sizeof(TmioStats));
+	leaveCriticalSection(savedState);
+#else
+	(void)portNum;
+#endif
 }
\ No newline at end of file
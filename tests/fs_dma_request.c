@@ -0,0 +1,122 @@
+#include <string.h>
+#include "drivers/gfx.h"
+#include "arm11/console.h"
+#include "arm11/fmt.h"
+#include "arm11/drivers/hid.h"
+#include "arm11/drivers/codec.h"
+#include "arm11/power.h"
+#include "fs.h"
+
+
+// Reads and writes through the async DMA requests on the ARM9 side.
+// Unaligned buffers go through the diskio bounce buffer and sequential
+// aligned reads start read-ahead. Both submit requests with buf = NULL.
+#define TEST_FILE   "sdmc:/fs_dma_request.bin"
+#define TEST_SIZE   (256u * 1024)
+#define CHUNK_SIZE  (24u * 1024) // Multiple sectors, more than one bounce buffer half.
+
+
+alignas(32) static u8 g_src[TEST_SIZE + 32];
+alignas(32) static u8 g_dst[TEST_SIZE + 32];
+
+
+
+static void fillPattern(u8 *const buf)
+{
+	u32 x = 0x12345678;
+	for(u32 i = 0; i < TEST_SIZE; i++)
+	{
+		x = x * 1664525 + 1013904223;
+		buf[i] = x>>24;
+	}
+}
+
+static Result writeFile(const u8 *const src)
+{
+	FHandle f;
+	Result res = fOpen(&f, TEST_FILE, FA_CREATE_ALWAYS | FA_WRITE);
+	if(res != RES_OK) return res;
+
+	for(u32 off = 0; off < TEST_SIZE && res == RES_OK; off += CHUNK_SIZE)
+	{
+		const u32 size = (TEST_SIZE - off < CHUNK_SIZE ? TEST_SIZE - off : CHUNK_SIZE);
+		res = fWrite(f, src + off, size, NULL);
+	}
+
+	const Result closeRes = fClose(f);
+
+	return (res != RES_OK ? res : closeRes);
+}
+
+static Result readFile(u8 *const dst)
+{
+	FHandle f;
+	Result res = fOpen(&f, TEST_FILE, FA_OPEN_EXISTING | FA_READ);
+	if(res != RES_OK) return res;
+
+	for(u32 off = 0; off < TEST_SIZE && res == RES_OK; off += CHUNK_SIZE)
+	{
+		const u32 size = (TEST_SIZE - off < CHUNK_SIZE ? TEST_SIZE - off : CHUNK_SIZE);
+		res = fRead(f, dst + off, size, NULL);
+	}
+
+	fClose(f);
+
+	return res;
+}
+
+// srcOff/dstOff misalign the buffers to force the bounce buffer path.
+static bool runPass(const char *const name, const u32 srcOff, const u32 dstOff)
+{
+	u8 *const src = g_src + srcOff;
+	u8 *const dst = g_dst + dstOff;
+	fillPattern(src);
+	memset(dst, 0, TEST_SIZE);
+
+	Result res = writeFile(src);
+	if(res == RES_OK) res = readFile(dst);
+	const bool ok = res == RES_OK && memcmp(src, dst, TEST_SIZE) == 0;
+	ee_printf("%s: %s (%lu)\n", name, (ok ? "ok" : "FAILED"), res);
+
+	return ok;
+}
+
+int main(void)
+{
+	GFX_init(GFX_BGR8, GFX_BGR565, GFX_TOP_2D);
+	GFX_setLcdLuminance(80);
+	consoleInit(GFX_LCD_BOT, NULL);
+
+	ee_puts("FS DMA request test");
+
+	Result res = fMount(FS_DRIVE_SDMC);
+	if(res != RES_OK)
+	{
+		ee_printf("Failed to mount SD card: %lu\n", res);
+		goto waitPower;
+	}
+
+	bool ok = runPass("aligned + read-ahead", 0, 0);
+	ok &= runPass("unaligned write", 1, 0);
+	ok &= runPass("unaligned read", 0, 3);
+	ok &= runPass("unaligned both", 2, 1);
+	ee_puts(ok ? "Passed" : "Failed");
+
+	fUnlink(TEST_FILE);
+	fUnmount(FS_DRIVE_SDMC);
+
+waitPower:
+	ee_puts("Press power to exit.");
+	while(1)
+	{
+		hidScanInput();
+		if(hidGetExtraKeys(0) & (KEY_POWER_HELD | KEY_POWER)) break;
+		GFX_waitForVBlank0();
+	}
+
+	CODEC_deinit();
+	GFX_deinit();
+	power_off();
+
+	return 0;
+}
@@ -0,0 +1,132 @@
+#include "drivers/gfx.h"
+#include "arm11/console.h"
+#include "arm11/fmt.h"
+#include "arm11/drivers/hid.h"
+#include "arm11/drivers/codec.h"
+#include "arm11/power.h"
+#include "fs.h"
+
+
+// Opens many files at once, checks that closed handles stay invalid
+// and that the per handle statistics add up.
+#define TEST_DIR     "sdmc:/fs_handles_test"
+#define NUM_FILES    (40u)
+#define WRITE_SIZE   (1000u)
+
+
+alignas(32) static u8 g_buf[WRITE_SIZE];
+static FHandle g_handles[NUM_FILES];
+
+
+
+static void makePath(char *const path, const u32 i)
+{
+	ee_sprintf(path, TEST_DIR "/%lu.bin", i);
+}
+
+static Result openAll(u32 *const openedOut)
+{
+	Result res = RES_OK;
+	u32 i;
+	for(i = 0; i < NUM_FILES; i++)
+	{
+		char path[64];
+		makePath(path, i);
+		res = fOpen(&g_handles[i], path, FA_CREATE_ALWAYS | FA_WRITE | FA_READ);
+		if(res != RES_OK) break;
+	}
+	*openedOut = i;
+
+	return res;
+}
+
+static bool checkStats(void)
+{
+	bool ok = true;
+	for(u32 i = 0; i < NUM_FILES; i++)
+	{
+		FHandle f = g_handles[i];
+		Result res = fWrite(f, g_buf, WRITE_SIZE, NULL);
+		if(res == RES_OK) res = fLseek(f, 0);
+		if(res == RES_OK) res = fRead(f, g_buf, WRITE_SIZE / 2, NULL);
+
+		FsFileStats stats;
+		if(res == RES_OK) res = fGetStats(f, &stats);
+		if(res != RES_OK || stats.bytesWritten != WRITE_SIZE ||
+		   stats.bytesRead != WRITE_SIZE / 2 || stats.seeks != 1)
+		{
+			ee_printf("File %lu: bad stats (%lu)\n", i, res);
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+int main(void)
+{
+	GFX_init(GFX_BGR8, GFX_BGR565, GFX_TOP_2D);
+	GFX_setLcdLuminance(80);
+	consoleInit(GFX_LCD_BOT, NULL);
+
+	ee_puts("FS handle test");
+
+	Result res = fMount(FS_DRIVE_SDMC);
+	if(res != RES_OK)
+	{
+		ee_printf("Failed to mount SD card: %lu\n", res);
+		goto waitPower;
+	}
+	fMkdir(TEST_DIR);
+
+	u32 opened;
+	res = openAll(&opened);
+	ee_printf("Opened %lu files (%lu)\n", opened, res);
+
+	bool ok = (res == RES_OK && checkStats());
+
+	for(u32 i = 0; i < opened; i++) fClose(g_handles[i]);
+
+	// Closed handles must be rejected even after their slots are reused.
+	const FHandle stale = g_handles[0];
+	FHandle reused;
+	res = fOpen(&reused, TEST_DIR "/0.bin", FA_OPEN_EXISTING | FA_READ);
+	if(res == RES_OK)
+	{
+		if(fTell(stale) != 0 || fRead(stale, g_buf, 1, NULL) != RES_FR_INVALID_OBJECT || reused == stale)
+		{
+			ee_puts("Stale handle was accepted");
+			ok = false;
+		}
+		fClose(reused);
+	}
+	else ok = false;
+	if(fClose(stale) != RES_FR_INVALID_OBJECT) ok = false;
+
+	for(u32 i = 0; i < opened; i++)
+	{
+		char path[64];
+		makePath(path, i);
+		fUnlink(path);
+	}
+	fUnlink(TEST_DIR);
+
+	ee_puts(ok ? "Passed" : "Failed");
+
+	fUnmount(FS_DRIVE_SDMC);
+
+waitPower:
+	ee_puts("Press power to exit.");
+	while(1)
+	{
+		hidScanInput();
+		if(hidGetExtraKeys(0) & (KEY_POWER_HELD | KEY_POWER)) break;
+		GFX_waitForVBlank0();
+	}
+
+	CODEC_deinit();
+	GFX_deinit();
+	power_off();
+
+	return 0;
+}
@@ -0,0 +1,133 @@
+#include "drivers/gfx.h"
+#include "arm11/console.h"
+#include "arm11/fmt.h"
+#include "arm11/drivers/hid.h"
+#include "arm11/drivers/timer.h"
+#include "arm11/drivers/codec.h"
+#include "arm11/power.h"
+#include "fs.h"
+
+
+// fStat() latency for a directory of files with a cold and a warm path lookup cache.
+// Also checks that stale results are dropped after fUnlink().
+#define TEST_DIR     "sdmc:/fs_path_cache_test/a/b/c"
+#define NUM_FILES    (16u)
+#define TIMER_PRESC  (256u)
+
+
+static const char *const g_dirs[4] = {"sdmc:/fs_path_cache_test", "sdmc:/fs_path_cache_test/a",
+                                      "sdmc:/fs_path_cache_test/a/b", TEST_DIR};
+
+
+
+static void makePath(char *const path, const u32 i)
+{
+	ee_sprintf(path, TEST_DIR "/%lu.cfg", i);
+}
+
+static Result createFiles(void)
+{
+	for(u32 i = 0; i < 4; i++) fMkdir(g_dirs[i]);
+
+	Result res = RES_OK;
+	for(u32 i = 0; i < NUM_FILES && res == RES_OK; i++)
+	{
+		char path[64];
+		makePath(path, i);
+		FHandle f;
+		res = fOpen(&f, path, FA_CREATE_ALWAYS | FA_WRITE);
+		if(res == RES_OK) res = fClose(f);
+	}
+
+	return res;
+}
+
+// Stats all files plus one missing file per existing one.
+static Result statAll(u32 *const usOut)
+{
+	Result res = RES_OK;
+	TIMER_start(TIMER_PRESC, 0xFFFFFFFFu, TIMER_SINGLE_SHOT);
+	for(u32 i = 0; i < NUM_FILES && res == RES_OK; i++)
+	{
+		char path[64];
+		makePath(path, i);
+		FILINFO fi;
+		res = fStat(path, &fi);
+		if(res == RES_OK && fStat(TEST_DIR "/missing.cfg", &fi) != RES_FR_NO_FILE) res = RES_FR_INT_ERR;
+	}
+	const u32 ticks = 0xFFFFFFFFu - TIMER_stop();
+	*usOut = (u32)((u64)ticks * 1000000 / (TIMER_BASE_FREQ / TIMER_PRESC));
+
+	return res;
+}
+
+int main(void)
+{
+	GFX_init(GFX_BGR8, GFX_BGR565, GFX_TOP_2D);
+	GFX_setLcdLuminance(80);
+	consoleInit(GFX_LCD_BOT, NULL);
+
+	ee_puts("FS path cache test");
+
+	Result res = fMount(FS_DRIVE_SDMC);
+	if(res != RES_OK)
+	{
+		ee_printf("Failed to mount SD card: %lu\n", res);
+		goto waitPower;
+	}
+
+	res = createFiles();
+	if(res != RES_OK)
+	{
+		ee_printf("Failed to create test files: %lu\n", res);
+		goto cleanup;
+	}
+
+	FsPathCacheStats before, after;
+	fGetPathCacheStats(&before);
+	u32 coldUs, warmUs;
+	res = statAll(&coldUs);
+	if(res == RES_OK) res = statAll(&warmUs);
+	fGetPathCacheStats(&after);
+	if(res != RES_OK)
+	{
+		ee_printf("fStat() failed: %lu\n", res);
+		goto cleanup;
+	}
+	ee_printf("cold: %lu us, warm: %lu us\nhits: %lu of %lu lookups\n", coldUs, warmUs,
+	          after.hits - before.hits, after.lookups - before.lookups);
+
+	{
+		char path[64];
+		makePath(path, 0);
+		FILINFO fi;
+		fUnlink(path);
+		ee_puts(fStat(path, &fi) == RES_FR_NO_FILE ? "Invalidation passed" : "Stale entry after fUnlink()");
+	}
+
+cleanup:
+	for(u32 i = 0; i < NUM_FILES; i++)
+	{
+		char path[64];
+		makePath(path, i);
+		fUnlink(path);
+	}
+	for(u32 i = 4; i > 0; i--) fUnlink(g_dirs[i - 1]);
+
+	fUnmount(FS_DRIVE_SDMC);
+
+waitPower:
+	ee_puts("Press power to exit.");
+	while(1)
+	{
+		hidScanInput();
+		if(hidGetExtraKeys(0) & (KEY_POWER_HELD | KEY_POWER)) break;
+		GFX_waitForVBlank0();
+	}
+
+	CODEC_deinit();
+	GFX_deinit();
+	power_off();
+
+	return 0;
+}
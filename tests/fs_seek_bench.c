@@ -0,0 +1,123 @@
+#include "drivers/gfx.h"
+#include "arm11/console.h"
+#include "arm11/fmt.h"
+#include "arm11/drivers/hid.h"
+#include "arm11/drivers/timer.h"
+#include "arm11/drivers/codec.h"
+#include "arm11/power.h"
+#include "fs.h"
+
+
+// Random seek + small read latency with and without FS_OPEN_FASTSEEK.
+// Without the cluster link map every backwards seek walks the FAT chain from the start.
+// The file is written in small chunks first so it's more likely to be fragmented.
+#define BENCH_FILE   "sdmc:/fs_seek_bench.bin"
+#define BENCH_SIZE   (32u * 1024 * 1024)
+#define READ_SIZE    (4096u)
+#define SEEKS        (256u)
+#define TIMER_PRESC  (256u)
+
+
+alignas(32) static u8 g_buf[65536];
+
+
+
+static Result createFile(void)
+{
+	FHandle f;
+	Result res = fOpen(&f, BENCH_FILE, FA_CREATE_ALWAYS | FA_WRITE);
+	if(res != RES_OK) return res;
+
+	for(u32 left = BENCH_SIZE; left > 0 && res == RES_OK; left -= sizeof(g_buf))
+		res = fWrite(f, g_buf, sizeof(g_buf), NULL);
+
+	const Result closeRes = fClose(f);
+
+	return (res != RES_OK ? res : closeRes);
+}
+
+static Result benchSeek(const u8 extraMode, u32 *const openTicksOut, u32 *const seekTicksOut)
+{
+	FHandle f;
+	TIMER_start(TIMER_PRESC, 0xFFFFFFFFu, TIMER_SINGLE_SHOT);
+	Result res = fOpen(&f, BENCH_FILE, FA_OPEN_EXISTING | FA_READ | extraMode);
+	*openTicksOut = 0xFFFFFFFFu - TIMER_stop();
+	if(res != RES_OK) return res;
+
+	// Same pseudo random offsets for both runs.
+	u32 seed = 0x12345678;
+	TIMER_start(TIMER_PRESC, 0xFFFFFFFFu, TIMER_SINGLE_SHOT);
+	for(u32 i = 0; i < SEEKS && res == RES_OK; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		const u32 off = (seed % (BENCH_SIZE / READ_SIZE)) * READ_SIZE;
+		res = fLseek(f, off);
+		if(res == RES_OK) res = fRead(f, g_buf, READ_SIZE, NULL);
+	}
+	*seekTicksOut = 0xFFFFFFFFu - TIMER_stop();
+
+	fClose(f);
+
+	return res;
+}
+
+int main(void)
+{
+	GFX_init(GFX_BGR8, GFX_BGR565, GFX_TOP_2D);
+	GFX_setLcdLuminance(80);
+	consoleInit(GFX_LCD_BOT, NULL);
+
+	ee_puts("FS seek benchmark");
+
+	Result res = fMount(FS_DRIVE_SDMC);
+	if(res != RES_OK)
+	{
+		ee_printf("Failed to mount SD card: %lu\n", res);
+		goto waitPower;
+	}
+
+	res = createFile();
+	if(res != RES_OK)
+	{
+		ee_printf("Failed to create test file: %lu\n", res);
+		goto unmount;
+	}
+
+	static const u8 modes[2] = {0, FS_OPEN_FASTSEEK};
+	static const char *const modeNames[2] = {"normal", "fast seek"};
+	for(u32 i = 0; i < 2; i++)
+	{
+		u32 openTicks, seekTicks;
+		res = benchSeek(modes[i], &openTicks, &seekTicks);
+		if(res != RES_OK)
+		{
+			ee_printf("%s: error %lu\n", modeNames[i], res);
+			continue;
+		}
+
+		const u32 timerFreq = TIMER_BASE_FREQ / TIMER_PRESC;
+		ee_printf("%s: open %lu us, %lu us per seek + read\n", modeNames[i],
+		          (u32)((u64)openTicks * 1000000 / timerFreq),
+		          (u32)((u64)seekTicks * 1000000 / timerFreq / SEEKS));
+	}
+
+	fUnlink(BENCH_FILE);
+
+unmount:
+	fUnmount(FS_DRIVE_SDMC);
+
+waitPower:
+	ee_puts("Press power to exit.");
+	while(1)
+	{
+		hidScanInput();
+		if(hidGetExtraKeys(0) & (KEY_POWER_HELD | KEY_POWER)) break;
+		GFX_waitForVBlank0();
+	}
+
+	CODEC_deinit();
+	GFX_deinit();
+	power_off();
+
+	return 0;
+}
@@ -0,0 +1,101 @@
+#include "drivers/gfx.h"
+#include "arm11/console.h"
+#include "arm11/fmt.h"
+#include "arm11/drivers/hid.h"
+#include "arm11/drivers/timer.h"
+#include "arm11/drivers/codec.h"
+#include "arm11/power.h"
+#include "fs.h"
+
+
+// Sequential file write throughput for different chunk sizes.
+// Odd chunk sizes produce multi-sector writes straddling allocation units.
+// Build the ARM9 side with DISKIO_COALESCE_SECTORS=0 to compare against
+// the uncoalesced write path. Each size also runs on a file preallocated
+// with fAllocate() which needs no FAT updates while writing.
+#define BENCH_FILE   "sdmc:/fs_write_bench.bin"
+#define BENCH_SIZE   (8u * 1024 * 1024)
+#define TIMER_PRESC  (256u)
+
+
+static const u32 g_chunkSizes[] = {4608, 24576, 24576 + 1536, 65536, 262144};
+alignas(32) static u8 g_buf[262144];
+
+
+
+static Result benchWrite(const u32 chunkSize, const bool prealloc, u32 *const ticksOut)
+{
+	FHandle f;
+	Result res = fOpen(&f, BENCH_FILE, FA_CREATE_ALWAYS | FA_WRITE);
+	if(res != RES_OK) return res;
+
+	TIMER_start(TIMER_PRESC, 0xFFFFFFFFu, TIMER_SINGLE_SHOT);
+	if(prealloc) res = fAllocate(f, BENCH_SIZE, FS_ALLOC_NOW);
+	u32 left = BENCH_SIZE;
+	while(left > 0 && res == RES_OK)
+	{
+		const u32 size = (left < chunkSize ? left : chunkSize);
+		res = fWrite(f, g_buf, size, NULL);
+		left -= size;
+	}
+
+	// Include the time for flushing buffered sectors.
+	const Result closeRes = fClose(f);
+	*ticksOut = 0xFFFFFFFFu - TIMER_stop();
+
+	return (res != RES_OK ? res : closeRes);
+}
+
+int main(void)
+{
+	GFX_init(GFX_BGR8, GFX_BGR565, GFX_TOP_2D);
+	GFX_setLcdLuminance(80);
+	consoleInit(GFX_LCD_BOT, NULL);
+
+	ee_puts("FS write benchmark");
+	for(u32 i = 0; i < sizeof(g_buf); i++) g_buf[i] = (u8)i;
+
+	Result res = fMount(FS_DRIVE_SDMC);
+	if(res != RES_OK)
+	{
+		ee_printf("Failed to mount SD card: %lu\n", res);
+		goto waitPower;
+	}
+
+	for(u32 i = 0; i < sizeof(g_chunkSizes) / sizeof(*g_chunkSizes); i++)
+	{
+		const u32 chunkSize = g_chunkSizes[i];
+		for(u32 prealloc = 0; prealloc < 2; prealloc++)
+		{
+			u32 ticks;
+			res = benchWrite(chunkSize, prealloc, &ticks);
+			if(res != RES_OK)
+			{
+				ee_printf("Chunk %lu%s: error %lu\n", chunkSize, (prealloc ? " prealloc" : ""), res);
+				continue;
+			}
+
+			const u32 timerFreq = TIMER_BASE_FREQ / TIMER_PRESC;
+			const u32 kibPerSec = (u32)((u64)BENCH_SIZE / 1024 * timerFreq / ticks);
+			ee_printf("Chunk %6lu%s: %lu KiB/s\n", chunkSize, (prealloc ? " prealloc" : ""), kibPerSec);
+		}
+	}
+
+	fUnlink(BENCH_FILE);
+	fUnmount(FS_DRIVE_SDMC);
+
+waitPower:
+	ee_puts("Press power to exit.");
+	while(1)
+	{
+		hidScanInput();
+		if(hidGetExtraKeys(0) & (KEY_POWER_HELD | KEY_POWER)) break;
+		GFX_waitForVBlank0();
+	}
+
+	CODEC_deinit();
+	GFX_deinit();
+	power_off();
+
+	return 0;
+}
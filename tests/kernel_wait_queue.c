@@ -0,0 +1,104 @@
+#include "drivers/gfx.h"
+#include "arm11/console.h"
+#include "arm11/fmt.h"
+#include "arm11/drivers/hid.h"
+#include "arm11/drivers/timer.h"
+#include "arm11/drivers/performance_monitor.h"
+#include "arm11/drivers/codec.h"
+#include "arm11/power.h"
+#include "kernel.h"
+#include "kmutex.h"
+#include "ksemaphore.h"
+
+
+// Measures worst case mutex wait times with contending tasks.
+// The main task runs at priority 2. Priority 1 is the idle task.
+#define ROUNDS  (2000u)
+
+
+typedef struct
+{
+	u8 prio;
+	u32 maxWait; // In CCNT ticks (64 cycles each).
+	u64 totalWait;
+} WaiterStats;
+
+static KHandle g_mutex = 0;
+static KHandle g_doneSema = 0;
+static WaiterStats g_stats[4] = {{2, 0, 0}, {2, 0, 0}, {2, 0, 0}, {3, 0, 0}};
+
+
+
+static void contender(void *arg)
+{
+	WaiterStats *const stats = (WaiterStats*)arg;
+
+	for(u32 i = 0; i < ROUNDS; i++)
+	{
+		const u32 start = __getCcnt();
+		lockMutex(g_mutex);
+		const u32 waited = __getCcnt() - start;
+		if(waited > stats->maxWait) stats->maxWait = waited;
+		stats->totalWait += waited;
+
+		// Let the others pile up on the mutex while we hold it.
+		yieldTask();
+		unlockMutex(g_mutex);
+		yieldTask();
+	}
+
+	signalSemaphore(g_doneSema, 1, false);
+	taskExit();
+}
+
+int main(void)
+{
+	GFX_init(GFX_BGR8, GFX_BGR565, GFX_TOP_2D);
+	GFX_setLcdLuminance(80);
+	consoleInit(GFX_LCD_BOT, NULL);
+
+	ee_puts("Kernel wait queue test");
+	g_mutex = createMutex();
+	g_doneSema = createSemaphore(0);
+	if(g_mutex == 0 || g_doneSema == 0)
+	{
+		ee_puts("Failed to create kernel objects.");
+		goto waitPower;
+	}
+
+	__setPmnc(0);
+	__setPmnc(PM_CCNT_DIV64 | PM_CCNT_RST | PM_EN);
+	const u32 numTasks = sizeof(g_stats) / sizeof(*g_stats);
+	for(u32 i = 0; i < numTasks; i++)
+	{
+		if(createTask(0x800, g_stats[i].prio, contender, &g_stats[i]) == 0)
+		{
+			ee_puts("Failed to create task.");
+			goto waitPower;
+		}
+	}
+	for(u32 i = 0; i < numTasks; i++) waitForSemaphore(g_doneSema);
+	__setPmnc(0);
+
+	for(u32 i = 0; i < numTasks; i++)
+	{
+		const WaiterStats *const stats = &g_stats[i];
+		ee_printf("Task %lu prio %u: max %lu avg %lu cycles\n", i, stats->prio,
+		          stats->maxWait * 64, (u32)(stats->totalWait * 64 / ROUNDS));
+	}
+
+waitPower:
+	ee_puts("Press power to exit.");
+	while(1)
+	{
+		hidScanInput();
+		if(hidGetExtraKeys(0) & (KEY_POWER_HELD | KEY_POWER)) break;
+		GFX_waitForVBlank0();
+	}
+
+	CODEC_deinit();
+	GFX_deinit();
+	power_off();
+
+	return 0;
+}
@@ -0,0 +1,122 @@
+#include "drivers/gfx.h"
+#include "arm11/console.h"
+#include "arm11/fmt.h"
+#include "arm11/drivers/hid.h"
+#include "arm11/drivers/timer.h"
+#include "drivers/tmio.h"
+#include "drivers/mmc/sdmmc.h"
+#include "arm11/drivers/codec.h"
+#include "arm11/power.h"
+
+
+// Sequential SD card read throughput in default and high speed bus mode.
+// Also prints the read latency distribution from the driver statistics
+// which needs TMIO_STATS enabled in tmio_config.h.
+// Only reads so it's safe to run on any card.
+#define BENCH_SECTORS  (16u * 2048) // 16 MiB.
+#define CHUNK_SECTORS  (128u)
+#define TIMER_PRESC    (256u)
+
+
+alignas(32) static u32 g_buf[CHUNK_SECTORS * 512 / 4];
+
+
+
+// Upper latency bound in µs of the histogram bucket containing the given percentile.
+static u32 histPercentileUs(const u32 hist[SDMMC_STATS_HIST_BUCKETS], const u32 total, const u32 percent)
+{
+	const u32 target = (total * percent + 99) / 100;
+	u32 sum = 0;
+	u32 bucket = 0;
+	for(; bucket < SDMMC_STATS_HIST_BUCKETS - 1; bucket++)
+	{
+		sum += hist[bucket];
+		if(sum >= target) break;
+	}
+
+	return (u32)((2ull<<bucket) * 1000000 / TMIO_STATS_TICK_FREQ);
+}
+
+static u32 benchRead(u32 *const ticksOut)
+{
+	TIMER_start(TIMER_PRESC, 0xFFFFFFFFu, TIMER_SINGLE_SHOT);
+	u32 res = SDMMC_ERR_NONE;
+	for(u32 sect = 0; sect < BENCH_SECTORS; sect += CHUNK_SECTORS)
+	{
+		res = SDMMC_readSectors(SDMMC_DEV_CARD, sect, g_buf, CHUNK_SECTORS);
+		if(res != SDMMC_ERR_NONE) break;
+	}
+	*ticksOut = 0xFFFFFFFFu - TIMER_stop();
+
+	return res;
+}
+
+int main(void)
+{
+	GFX_init(GFX_BGR8, GFX_BGR565, GFX_TOP_2D);
+	GFX_setLcdLuminance(80);
+	consoleInit(GFX_LCD_BOT, NULL);
+
+	ee_puts("SD bus mode benchmark");
+	TMIO_init();
+
+	u32 res = SDMMC_init(SDMMC_DEV_CARD);
+	if(res != SDMMC_ERR_NONE)
+	{
+		ee_printf("SD init failed: %lu\n", res);
+		goto waitPower;
+	}
+
+	static const char *const modeNames[2] = {"default", "high speed"};
+	for(u8 mode = SDMMC_BUS_MODE_DEFAULT; mode <= SDMMC_BUS_MODE_HS; mode++)
+	{
+		res = SDMMC_setBusMode(SDMMC_DEV_CARD, mode);
+		if(res != SDMMC_ERR_NONE)
+		{
+			ee_printf("%s: not available (%lu)\n", modeNames[mode], res);
+			continue;
+		}
+
+		SDMMC_resetStats(SDMMC_DEV_CARD);
+		u32 ticks;
+		res = benchRead(&ticks);
+
+		// The driver may fall back to default speed on CRC errors.
+		SdmmcInfo info;
+		SDMMC_getDevInfo(SDMMC_DEV_CARD, &info);
+		if(res != SDMMC_ERR_NONE)
+		{
+			ee_printf("%s: read error %lu\n", modeNames[mode], res);
+			continue;
+		}
+
+		const u32 timerFreq = TIMER_BASE_FREQ / TIMER_PRESC;
+		const u32 kibPerSec = (u32)((u64)BENCH_SECTORS / 2 * timerFreq / ticks);
+		ee_printf("%s: %lu Hz, %lu KiB/s%s\n", modeNames[mode], info.clock, kibPerSec,
+		          (info.busMode != mode ? " (fell back)" : ""));
+
+		SdmmcStats stats;
+		SDMMC_getStats(SDMMC_DEV_CARD, &stats);
+		ee_printf(" reads: %lu, errors: %lu, retries: %lu\n p50 <= %lu us, p99 <= %lu us\n",
+		          stats.reads, stats.readErrors, stats.retries,
+		          histPercentileUs(stats.readHist, stats.reads, 50),
+		          histPercentileUs(stats.readHist, stats.reads, 99));
+	}
+
+	SDMMC_deinit(SDMMC_DEV_CARD);
+
+waitPower:
+	ee_puts("Press power to exit.");
+	while(1)
+	{
+		hidScanInput();
+		if(hidGetExtraKeys(0) & (KEY_POWER_HELD | KEY_POWER)) break;
+		GFX_waitForVBlank0();
+	}
+
+	CODEC_deinit();
+	GFX_deinit();
+	power_off();
+
+	return 0;
+}
@@ -51,7 +51,7 @@ static u32 printCardInfos(void)
 	{
 		ee_printf("%08lX", info.cid[i]);
 	}
-	ee_printf("\n Bus width: %u bit\n Clock: %lu Hz\n", info.busWidth, info.clock);
+	ee_printf("\n Bus width: %u bit\n Clock: %lu Hz\n AU size: %lu KiB\n Bus mode: %u\n", info.busWidth, info.clock, info.auSize / 2, info.busMode);
 
 	return info.sectors;
 }
@@ -77,7 +77,7 @@ int main(void)
 		}
 
 		ee_printf("\x1b[1;0H\x1b[0J\x1b[1;0H");
-		ee_printf("Card inserted: %u\n", TMIO_cardDetected());
+		ee_printf("Card inserted: %u (%lu insert/remove events)\n", TMIO_cardDetected(), TMIO_getCardChanges());
 		u32 tries = 3;
 		u32 initRes;
 		do
@@ -0,0 +1,131 @@
+#include "drivers/gfx.h"
+#include "arm11/console.h"
+#include "arm11/fmt.h"
+#include "arm11/drivers/hid.h"
+#include "arm11/drivers/timer.h"
+#include "drivers/tmio.h"
+#include "drivers/mmc/sdmmc.h"
+#include "arm11/drivers/codec.h"
+#include "arm11/power.h"
+
+
+// SD card idle power policy. Lets the card fall asleep via the idle timeout
+// and measures how long sync and async reads take to wake it up again.
+// The sleep statistics need TMIO_STATS enabled in tmio_config.h.
+// Only reads so it's safe to run on any card.
+#define IDLE_TIMEOUT_MS  (50u)
+#define READ_SECTORS     (8u)
+#define TIMER_PRESC      (1u)
+
+
+alignas(32) static u32 g_buf[READ_SECTORS * 512 / 4];
+
+
+
+static u32 ticksToUs(const u32 ticks)
+{
+	return (u32)((u64)ticks * TIMER_PRESC * 1000000 / TIMER_BASE_FREQ);
+}
+
+// Polls the idle policy until the card is asleep.
+static bool waitForSleep(void)
+{
+	SdmmcStats stats;
+	SDMMC_getStats(SDMMC_DEV_CARD, &stats);
+	const u32 sleeps = stats.sleeps;
+	for(u32 i = 0; i < 20; i++)
+	{
+		TIMER_sleepMs(10);
+		if(SDMMC_pollIdle(SDMMC_DEV_CARD) != SDMMC_ERR_NONE) return false;
+
+		SDMMC_getStats(SDMMC_DEV_CARD, &stats);
+		if(stats.sleeps != sleeps) return true;
+	}
+
+	return false;
+}
+
+static u32 timedSyncRead(u32 *const usOut)
+{
+	TIMER_start(TIMER_PRESC, 0xFFFFFFFFu, TIMER_SINGLE_SHOT);
+	const u32 res = SDMMC_readSectors(SDMMC_DEV_CARD, 0, g_buf, READ_SECTORS);
+	*usOut = ticksToUs(0xFFFFFFFFu - TIMER_stop());
+
+	return res;
+}
+
+int main(void)
+{
+	GFX_init(GFX_BGR8, GFX_BGR565, GFX_TOP_2D);
+	GFX_setLcdLuminance(80);
+	consoleInit(GFX_LCD_BOT, NULL);
+
+	ee_puts("SD idle power test");
+	TMIO_init();
+
+	u32 res = SDMMC_init(SDMMC_DEV_CARD);
+	if(res != SDMMC_ERR_NONE)
+	{
+		ee_printf("SD init failed: %lu\n", res);
+		goto waitPower;
+	}
+
+	res = SDMMC_setIdleTimeout(SDMMC_DEV_CARD, IDLE_TIMEOUT_MS);
+	if(res != SDMMC_ERR_NONE)
+	{
+		ee_printf("Idle timeout not available: %lu\n", res);
+		goto deinit;
+	}
+	SDMMC_resetStats(SDMMC_DEV_CARD);
+
+	u32 awakeUs, wakeUs;
+	res = timedSyncRead(&awakeUs);
+	if(res != SDMMC_ERR_NONE || !waitForSleep())
+	{
+		ee_printf("Card didn't fall asleep (%lu)\n", res);
+		goto deinit;
+	}
+	res = timedSyncRead(&wakeUs);
+	ee_printf("Sync read: %lu us awake, %lu us asleep (%lu)\n", awakeUs, wakeUs, res);
+
+	if(!waitForSleep())
+	{
+		ee_puts("Card didn't fall asleep again");
+		goto deinit;
+	}
+	{
+		// The wake up runs in the background. Submit returns right away.
+		SdmmcReq req = {.sect = 0, .buf = g_buf, .count = READ_SECTORS, .op = SDMMC_REQ_READ};
+		TIMER_start(TIMER_PRESC, 0xFFFFFFFFu, TIMER_SINGLE_SHOT);
+		res = SDMMC_submitRequest(SDMMC_DEV_CARD, &req);
+		const u32 submitTicks = 0xFFFFFFFFu - TIMER_getTicks();
+		if(res == SDMMC_ERR_NONE) res = SDMMC_waitRequest(&req);
+		const u32 totalTicks = 0xFFFFFFFFu - TIMER_stop();
+		ee_printf("Async read: submit %lu us, done %lu us (%lu)\n",
+		          ticksToUs(submitTicks), ticksToUs(totalTicks), res);
+	}
+
+	SdmmcStats stats;
+	SDMMC_getStats(SDMMC_DEV_CARD, &stats);
+	ee_printf("sleeps: %lu, wakes: %lu (%lu async)\nasleep: %lu ms\n",
+	          stats.sleeps, stats.wakes, stats.asyncWakes,
+	          (u32)(stats.asleepTicks * 1000 / TMIO_STATS_TICK_FREQ));
+
+deinit:
+	SDMMC_deinit(SDMMC_DEV_CARD);
+
+waitPower:
+	ee_puts("Press power to exit.");
+	while(1)
+	{
+		hidScanInput();
+		if(hidGetExtraKeys(0) & (KEY_POWER_HELD | KEY_POWER)) break;
+		GFX_waitForVBlank0();
+	}
+
+	CODEC_deinit();
+	GFX_deinit();
+	power_off();
+
+	return 0;
+}
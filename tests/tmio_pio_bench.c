@@ -0,0 +1,99 @@
+#include "drivers/gfx.h"
+#include "arm11/console.h"
+#include "arm11/fmt.h"
+#include "arm11/drivers/hid.h"
+#include "arm11/drivers/performance_monitor.h"
+#include "drivers/tmio.h"
+#include "drivers/mmc/sdmmc.h"
+#include "arm11/drivers/codec.h"
+#include "arm11/power.h"
+
+
+// CPU cycles per sector for SD card reads with differently aligned buffers.
+// 32 byte aligned buffers use the CDMA, everything else goes through PIO.
+// Only reads so it's safe to run on any card.
+#define BENCH_SECTORS  (4096u) // 2 MiB.
+#define CHUNK_SECTORS  (64u)
+
+
+typedef struct
+{
+	const char *name;
+	u32 offset; // Byte offset from a 32 byte aligned address.
+} BenchCase;
+
+static const BenchCase g_cases[] =
+{
+	{"aligned 32 (CDMA)", 0},
+	{"aligned 4 (PIO)",   4},
+	{"unaligned +1",      1},
+	{"unaligned +2",      2},
+	{"unaligned +3",      3}
+};
+alignas(32) static u8 g_buf[CHUNK_SECTORS * 512 + 32];
+
+
+
+static u32 benchRead(const u32 offset, u32 *const cyclesOut)
+{
+	u32 res = SDMMC_ERR_NONE;
+	__setPmnc(0);
+	__setPmnc(PM_CCNT_NODIV | PM_CCNT_RST | PM_EN);
+	for(u32 sect = 0; sect < BENCH_SECTORS; sect += CHUNK_SECTORS)
+	{
+		res = SDMMC_readSectors(SDMMC_DEV_CARD, sect, &g_buf[offset], CHUNK_SECTORS);
+		if(res != SDMMC_ERR_NONE) break;
+	}
+	*cyclesOut = __getCcnt();
+	__setPmnc(0);
+
+	return res;
+}
+
+int main(void)
+{
+	GFX_init(GFX_BGR8, GFX_BGR565, GFX_TOP_2D);
+	GFX_setLcdLuminance(80);
+	consoleInit(GFX_LCD_BOT, NULL);
+
+	ee_puts("TMIO PIO benchmark");
+	TMIO_init();
+
+	u32 res = SDMMC_init(SDMMC_DEV_CARD);
+	if(res != SDMMC_ERR_NONE)
+	{
+		ee_printf("SD init failed: %lu\n", res);
+		goto waitPower;
+	}
+
+	for(u32 i = 0; i < sizeof(g_cases) / sizeof(*g_cases); i++)
+	{
+		const BenchCase *const bc = &g_cases[i];
+		u32 cycles;
+		res = benchRead(bc->offset, &cycles);
+		if(res != SDMMC_ERR_NONE)
+		{
+			ee_printf("%s: read error %lu\n", bc->name, res);
+			continue;
+		}
+
+		ee_printf("%s: %lu cycles/sector\n", bc->name, cycles / BENCH_SECTORS);
+	}
+
+	SDMMC_deinit(SDMMC_DEV_CARD);
+
+waitPower:
+	ee_puts("Press power to exit.");
+	while(1)
+	{
+		hidScanInput();
+		if(hidGetExtraKeys(0) & (KEY_POWER_HELD | KEY_POWER)) break;
+		GFX_waitForVBlank0();
+	}
+
+	CODEC_deinit();
+	GFX_deinit();
+	power_off();
+
+	return 0;
+}